@@ -0,0 +1,62 @@
+#pragma once
+
+#include "common.h"
+#include "bios.h"
+
+#include <string>
+#include <vector>
+
+
+/* One line of the manifest: a ROM played back from a movie or run for a number of frames */
+struct BatchJob
+{
+	unsigned int line;
+	std::string rom;
+	Bios::Type machine;
+	std::string movie;
+	u64 frames;
+	std::string state; /* where to write the final save state, if anywhere */
+};
+
+struct BatchResult
+{
+	bool ok;
+	bool synced;
+	bool stopped;
+	u64 frames;
+	f64 seconds;
+	u64 stateHash;
+
+	inline f64 fps() const { return seconds > 0 ? frames / seconds : 0; }
+};
+
+/* Every job of the manifest run once on a number of threads */
+struct BatchRun
+{
+	unsigned int threads;
+	f64 seconds;
+	u64 steals;
+	std::vector<BatchResult> results;
+
+	u64 frames() const;
+	inline f64 fps() const { return seconds > 0 ? frames() / seconds : 0; }
+};
+
+
+/* Manifest lines are whitespace separated key=value pairs; '#' starts a comment.
+ *   rom=<file>       required
+ *   machine=gb|gbc   ignored with a movie, which knows its machine (default gb)
+ *   movie=<file>     replays the movie, verifying its frame hashes
+ *   frames=<count>   runs with no input for that many frames
+ *   state=<file>     writes the final save state there
+ * Either movie or frames is required. Paths may not contain spaces. */
+bool ReadBatchManifest(const char* filename, std::vector<BatchJob>& jobs);
+
+/* Runs the job on a machine of its own; shares nothing with the other jobs */
+void RunBatchJob(const BatchJob& job, BatchResult& result, const bool writeOutputs);
+
+void RunBatch(const std::vector<BatchJob>& jobs, const unsigned int threads, BatchRun& run, const bool writeOutputs);
+
+/* The runs as JSON: each job with the frames/sec of every run, then every run with its
+ * speedup and scaling efficiency against the single threaded one (or the first) */
+void WriteBatchReport(std::ostream& os, const std::vector<BatchJob>& jobs, const std::vector<BatchRun>& runs);
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "common.h"
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+
+/* Runs a set of tasks on a fixed number of threads. Tasks are dealt round-robin to
+ * a queue per worker; a worker runs its own queue in submission order and, once it
+ * runs dry, steals from the back of the others (their last, shortest tasks when
+ * submitted longest first), so a few long jobs do not leave the rest of the threads
+ * idle. Every task is submitted before run(). */
+class WorkPool
+{
+public:
+	typedef std::function<void()> Task;
+
+private:
+	struct Queue
+	{
+		std::mutex lock;
+		std::deque<Task> tasks;
+	};
+
+	std::vector<std::unique_ptr<Queue>> _queues;
+	size_t _next;
+	std::atomic<u64> _steals;
+
+public:
+	WorkPool(const unsigned int threads);
+	WorkPool(const WorkPool&) = delete;
+
+	WorkPool& operator= (const WorkPool&) = delete;
+
+	void submit(Task task);
+
+	/* Blocks until every task ran */
+	void run();
+
+	inline unsigned int threads() const { return static_cast<unsigned int>(_queues.size()); }
+	inline u64 steals() const { return _steals; }
+
+private:
+	void work(const size_t worker);
+
+	bool pop(const size_t worker, Task& task);
+	bool steal(const size_t worker, Task& task);
+};
@@ -0,0 +1,260 @@
+#include "batch.h"
+#include "work_pool.h"
+
+#include "vm.h"
+#include "movie.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+typedef std::chrono::steady_clock Clock;
+
+
+static bool parseJob(const std::string& text, const unsigned int line, BatchJob& job)
+{
+	std::istringstream tokens{ text };
+	std::string token;
+
+	job.line = line;
+	job.rom.clear();
+	job.machine = Bios::Type::GameBoy;
+	job.movie.clear();
+	job.frames = 0;
+	job.state.clear();
+
+	while (tokens >> token)
+	{
+		const size_t equals = token.find('=');
+		CHECK_MSG(equals != std::string::npos && equals > 0, "manifest line %u: expected key=value, found \"%s\".\n", line, token.c_str());
+
+		{
+			const std::string key = token.substr(0, equals);
+			const std::string value = token.substr(equals + 1);
+
+			if (key == "rom")
+				job.rom = value;
+			else if (key == "machine")
+			{
+				CHECK_MSG(value == "gb" || value == "gbc", "manifest line %u: unknown machine \"%s\".\n", line, value.c_str());
+				job.machine = value == "gbc" ? Bios::Type::GameBoyColor : Bios::Type::GameBoy;
+			}
+			else if (key == "movie")
+				job.movie = value;
+			else if (key == "frames")
+			{
+				char* end;
+				job.frames = std::strtoull(value.c_str(), &end, 10);
+				CHECK_MSG(!value.empty() && *end == '\0', "manifest line %u: invalid frame count \"%s\".\n", line, value.c_str());
+			}
+			else if (key == "state")
+				job.state = value;
+			else CHECK_MSG(false, "manifest line %u: unknown key \"%s\".\n", line, key.c_str());
+		}
+	}
+
+	CHECK_MSG(!job.rom.empty(), "manifest line %u: missing rom.\n", line);
+	CHECK_MSG(!job.movie.empty() || job.frames > 0, "manifest line %u: needs a movie or a frame count.\n", line);
+	return OK;
+
+	ON_ERROR_RETURN;
+}
+
+bool ReadBatchManifest(const char* filename, std::vector<BatchJob>& jobs)
+{
+	std::ifstream f{ filename };
+	std::string text;
+	unsigned int line = 0;
+
+	CHECK_MSG(f, "unable to open file \"%s\".\n", filename);
+
+	jobs.clear();
+	while (std::getline(f, text))
+	{
+		++line;
+		text = text.substr(0, text.find('#'));
+		if (text.find_first_not_of(" \t\r") == std::string::npos)
+			continue;
+
+		BatchJob job;
+		CHECK(SUCCESS(parseJob(text, line, job)));
+		jobs.push_back(std::move(job));
+	}
+	CHECK_MSG(!jobs.empty(), "the manifest has no jobs.\n");
+	return OK;
+
+	ON_ERROR_RETURN;
+}
+
+void RunBatchJob(const BatchJob& job, BatchResult& result, const bool writeOutputs)
+{
+	Movie movie;
+	std::unique_ptr<VirtualMachine> vm;
+	SaveState state;
+
+	result.ok = false;
+	result.synced = true;
+	result.stopped = false;
+	result.frames = 0;
+	result.seconds = 0;
+	result.stateHash = 0;
+
+	if (!job.movie.empty())
+		CHECK(SUCCESS(movie.read(job.movie.c_str())));
+
+	vm = std::make_unique<VirtualMachine>(job.movie.empty() ? job.machine : movie.machine(), true);
+	CHECK(SUCCESS(vm->mmu.loadRom(job.rom.c_str())));
+
+	{
+		const Clock::time_point start = Clock::now();
+
+		if (!job.movie.empty())
+		{
+			MovieReplay replay;
+			CHECK(SUCCESS(movie.replay(*vm, HashBytes(vm->mmu.rom(), vm->mmu.romSize()), replay)));
+			result.frames = replay.frames;
+			result.synced = replay.synced();
+			result.stopped = replay.stopped;
+		}
+		else
+		{
+			while (result.frames < job.frames)
+			{
+				const RunStatus status = vm->runFrame();
+				if (status == RunStatus::Stopped)
+				{
+					result.stopped = true;
+					break;
+				}
+				if (status == RunStatus::FrameComplete)
+					result.frames++;
+			}
+		}
+
+		result.seconds = std::chrono::duration<f64>(Clock::now() - start).count();
+	}
+
+	vm->saveState(state);
+	result.stateHash = state.hash();
+	if (writeOutputs && !job.state.empty())
+		CHECK(SUCCESS(state.write(job.state.c_str())));
+
+	result.ok = true;
+	return;
+
+__error:
+	PRINT_ERROR("manifest line %u: job failed.\n", job.line);
+}
+
+u64 BatchRun::frames() const
+{
+	u64 total = 0;
+	for (const BatchResult& result : results)
+		total += result.frames;
+	return total;
+}
+
+void RunBatch(const std::vector<BatchJob>& jobs, const unsigned int threads, BatchRun& run, const bool writeOutputs)
+{
+	WorkPool pool{ threads };
+
+	run.threads = pool.threads();
+	run.results.assign(jobs.size(), BatchResult{});
+
+	/* longest first, so the big jobs do not end up last on a busy thread */
+	std::vector<size_t> order(jobs.size());
+	for (size_t i = 0; i < order.size(); i++)
+		order[i] = i;
+	std::stable_sort(order.begin(), order.end(), [&jobs](size_t a, size_t b) { return jobs[a].frames > jobs[b].frames; });
+
+	for (const size_t index : order)
+		pool.submit([&jobs, &run, index, writeOutputs]() { RunBatchJob(jobs[index], run.results[index], writeOutputs); });
+
+	const Clock::time_point start = Clock::now();
+	pool.run();
+	run.seconds = std::chrono::duration<f64>(Clock::now() - start).count();
+	run.steals = pool.steals();
+}
+
+
+static std::string jsonString(const std::string& text)
+{
+	std::string out = "\"";
+	for (const char c : text)
+	{
+		if (c == '"' || c == '\\')
+		{
+			out += '\\';
+			out += c;
+		}
+		else if (static_cast<unsigned char>(c) < 0x20)
+		{
+			char escape[8];
+			std::snprintf(escape, sizeof(escape), "\\u%04x", c);
+			out += escape;
+		}
+		else out += c;
+	}
+	return out + "\"";
+}
+
+static std::string jsonHash(const u64 hash)
+{
+	char text[24];
+	std::snprintf(text, sizeof(text), "\"%016llx\"", static_cast<unsigned long long>(hash));
+	return text;
+}
+
+void WriteBatchReport(std::ostream& os, const std::vector<BatchJob>& jobs, const std::vector<BatchRun>& runs)
+{
+	const BatchRun* base = nullptr;
+	for (const BatchRun& run : runs)
+		if (!base || run.threads == 1)
+			base = &run;
+
+	os << "{\n\t\"jobs\": [";
+	for (size_t i = 0; i < jobs.size(); i++)
+	{
+		const BatchJob& job = jobs[i];
+		const BatchResult& first = runs.front().results[i];
+		bool deterministic = true;
+		for (const BatchRun& run : runs)
+			deterministic = deterministic && run.results[i].ok && run.results[i].stateHash == first.stateHash;
+
+		os << (i ? ",\n" : "\n") << "\t\t{\n";
+		os << "\t\t\t\"line\": " << job.line << ",\n";
+		os << "\t\t\t\"rom\": " << jsonString(job.rom) << ",\n";
+		if (!job.movie.empty())
+			os << "\t\t\t\"movie\": " << jsonString(job.movie) << ",\n";
+		os << "\t\t\t\"ok\": " << (first.ok ? "true" : "false") << ",\n";
+		os << "\t\t\t\"frames\": " << first.frames << ",\n";
+		os << "\t\t\t\"synced\": " << (first.synced ? "true" : "false") << ",\n";
+		os << "\t\t\t\"stopped\": " << (first.stopped ? "true" : "false") << ",\n";
+		os << "\t\t\t\"state_hash\": " << jsonHash(first.stateHash) << ",\n";
+		os << "\t\t\t\"deterministic\": " << (deterministic ? "true" : "false") << ",\n";
+		os << "\t\t\t\"fps\": {";
+		for (size_t r = 0; r < runs.size(); r++)
+			os << (r ? ", " : " ") << "\"" << runs[r].threads << "\": " << runs[r].results[i].fps();
+		os << " }\n\t\t}";
+	}
+
+	os << "\n\t],\n\t\"runs\": [";
+	for (size_t r = 0; r < runs.size(); r++)
+	{
+		const BatchRun& run = runs[r];
+		const f64 speedup = base->fps() > 0 ? run.fps() / base->fps() : 0;
+
+		os << (r ? ",\n" : "\n") << "\t\t{ ";
+		os << "\"threads\": " << run.threads << ", ";
+		os << "\"seconds\": " << run.seconds << ", ";
+		os << "\"frames\": " << run.frames() << ", ";
+		os << "\"fps\": " << run.fps() << ", ";
+		os << "\"steals\": " << run.steals << ", ";
+		os << "\"speedup\": " << speedup << ", ";
+		os << "\"efficiency\": " << speedup * base->threads / run.threads << " }";
+	}
+	os << "\n\t]\n}\n";
+}
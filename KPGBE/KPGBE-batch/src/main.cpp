@@ -0,0 +1,95 @@
+#include "batch.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+
+static bool parseThreads(const char* text, std::vector<unsigned int>& threads)
+{
+	threads.clear();
+	while (*text)
+	{
+		char* end;
+		const unsigned long count = std::strtoul(text, &end, 10);
+		if (end == text || count == 0 || (*end != ',' && *end != '\0'))
+			return false;
+
+		threads.push_back(static_cast<unsigned int>(count));
+		text = *end ? end + 1 : end;
+	}
+	return !threads.empty();
+}
+
+static void usage()
+{
+	std::cerr << "usage: kpgbe-batch <manifest> [--threads 1,2,4] [--report report.json]" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+	const char* manifest = nullptr;
+	const char* reportFile = nullptr;
+	std::vector<unsigned int> threads{ 1 };
+	if (std::thread::hardware_concurrency() > 1)
+		threads.push_back(std::thread::hardware_concurrency());
+
+	for (int i = 1; i < argc; i++)
+	{
+		const std::string arg = argv[i];
+		if (arg == "--threads" && i + 1 < argc)
+		{
+			if (!parseThreads(argv[++i], threads))
+			{
+				usage();
+				return 1;
+			}
+		}
+		else if (arg == "--report" && i + 1 < argc)
+			reportFile = argv[++i];
+		else if (!manifest && arg[0] != '-')
+			manifest = argv[i];
+		else
+		{
+			usage();
+			return 1;
+		}
+	}
+	if (!manifest)
+	{
+		usage();
+		return 1;
+	}
+
+	std::vector<BatchJob> jobs;
+	if (!ReadBatchManifest(manifest, jobs))
+		return 1;
+
+	std::vector<BatchRun> runs(threads.size());
+	for (size_t i = 0; i < threads.size(); i++)
+	{
+		/* outputs are the same on every run, only the first writes them */
+		RunBatch(jobs, threads[i], runs[i], i == 0);
+		std::cerr << runs[i].threads << " threads: " << runs[i].frames() << " frames in " << runs[i].seconds << " s" << std::endl;
+	}
+
+	bool failed = false;
+	for (const BatchRun& run : runs)
+		for (const BatchResult& result : run.results)
+			failed = failed || !result.ok || !result.synced;
+
+	if (reportFile)
+	{
+		std::ofstream f{ reportFile };
+		if (!f)
+		{
+			std::cerr << "unable to open file \"" << reportFile << "\"." << std::endl;
+			return 1;
+		}
+		WriteBatchReport(f, jobs, runs);
+	}
+	else WriteBatchReport(std::cout, jobs, runs);
+
+	return failed ? 2 : 0;
+}
@@ -0,0 +1,73 @@
+#include "work_pool.h"
+
+#include <thread>
+
+
+WorkPool::WorkPool(const unsigned int threads) :
+	_queues{},
+	_next{ 0 },
+	_steals{ 0 }
+{
+	for (unsigned int i = 0; i < max(threads, 1U); i++)
+		_queues.push_back(std::make_unique<Queue>());
+}
+
+void WorkPool::submit(Task task)
+{
+	_queues[_next]->tasks.push_back(std::move(task));
+	_next = (_next + 1) % _queues.size();
+}
+
+void WorkPool::run()
+{
+	std::vector<std::thread> workers;
+	for (size_t i = 1; i < _queues.size(); i++)
+		workers.emplace_back(&WorkPool::work, this, i);
+
+	/* the calling thread is worker #0 */
+	work(0);
+
+	for (std::thread& worker : workers)
+		worker.join();
+	_next = 0;
+}
+
+void WorkPool::work(const size_t worker)
+{
+	Task task;
+	while (pop(worker, task) || steal(worker, task))
+	{
+		task();
+		task = nullptr;
+	}
+}
+
+bool WorkPool::pop(const size_t worker, Task& task)
+{
+	Queue& queue = *_queues[worker];
+	std::lock_guard<std::mutex> guard{ queue.lock };
+	if (queue.tasks.empty())
+		return false;
+
+	task = std::move(queue.tasks.front());
+	queue.tasks.pop_front();
+	return true;
+}
+
+bool WorkPool::steal(const size_t worker, Task& task)
+{
+	/* nothing is submitted while running: once every queue was seen empty, the work is done */
+	for (size_t i = 1; i < _queues.size(); i++)
+	{
+		Queue& queue = *_queues[(worker + i) % _queues.size()];
+		std::lock_guard<std::mutex> guard{ queue.lock };
+		if (queue.tasks.empty())
+			continue;
+
+		task = std::move(queue.tasks.back());
+		queue.tasks.pop_back();
+		_steals++;
+		return true;
+	}
+	return false;
+}
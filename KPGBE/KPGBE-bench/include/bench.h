@@ -0,0 +1,61 @@
+#pragma once
+
+#include "common.h"
+
+#include <chrono>
+#include <vector>
+
+
+/* Collects benchmark results and prints them as "name<TAB>value<TAB>unit" lines */
+class BenchmarkReport
+{
+private:
+	struct Result
+	{
+		std::string name;
+		f64 value;
+		std::string unit;
+	};
+
+	std::string _filter;
+	std::vector<Result> _results;
+
+public:
+	BenchmarkReport(const std::string& filter);
+
+	bool enabled(const std::string& name) const;
+
+	void add(const std::string& name, const f64 value, const std::string& unit);
+
+	void print(std::ostream& os) const;
+};
+
+
+/* Runs fn until at least minSeconds elapsed and returns the seconds per call */
+template<typename _Fn>
+f64 MeasureSecondsPerCall(_Fn fn, const f64 minSeconds = 0.25)
+{
+	typedef std::chrono::steady_clock Clock;
+
+	u64 calls = 0;
+	u64 batch = 1;
+	const Clock::time_point start = Clock::now();
+	f64 elapsed = 0;
+	do
+	{
+		for (u64 i = 0; i < batch; i++)
+			fn();
+		calls += batch;
+		batch *= 2;
+		elapsed = std::chrono::duration<f64>(Clock::now() - start).count();
+	}
+	while (elapsed < minSeconds);
+
+	return elapsed / static_cast<f64>(calls);
+}
+
+
+void RunScalerBenchmarks(BenchmarkReport& report);
+void RunResamplerBenchmarks(BenchmarkReport& report);
+void RunCpuBenchmarks(BenchmarkReport& report);
+void RunMemoryBenchmarks(BenchmarkReport& report);
@@ -0,0 +1,23 @@
+#include "bench.h"
+
+
+BenchmarkReport::BenchmarkReport(const std::string& filter) :
+	_filter{ filter },
+	_results{}
+{}
+
+bool BenchmarkReport::enabled(const std::string& name) const
+{
+	return _filter.empty() || name.compare(0, _filter.size(), _filter) == 0;
+}
+
+void BenchmarkReport::add(const std::string& name, const f64 value, const std::string& unit)
+{
+	_results.push_back({ name, value, unit });
+}
+
+void BenchmarkReport::print(std::ostream& os) const
+{
+	for (const Result& result : _results)
+		os << result.name << '\t' << result.value << '\t' << result.unit << std::endl;
+}
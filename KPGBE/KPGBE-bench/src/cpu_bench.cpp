@@ -0,0 +1,267 @@
+#include "bench.h"
+
+#include "vm.h"
+#include "opcodes.h"
+
+#include <cstdio>
+
+/* hundreds of entries: a shorter run each keeps the whole suite within seconds */
+#define OPCODE_BENCH_SECONDS 0.02
+
+#define BENCH_PC 0xC000
+#define BENCH_SP 0xDFF0
+#define BENCH_BC 0xC280 /* C points (FF00+C) at high RAM */
+#define BENCH_DE 0xC300
+#define BENCH_HL 0xC100
+#define BENCH_BYTE_OPERAND 0x80
+#define BENCH_WORD_OPERAND 0xC400
+
+/* results of measured reads land here, so they cannot be optimized away */
+static volatile u32 BenchSink;
+
+
+/* A headless machine with every register pointing at work RAM, which is filled with a
+ * byte pattern. Each measured call starts from these registers again, so jumps, calls
+ * and stack operations always hit the same memory. */
+static std::unique_ptr<VirtualMachine> MakeBenchMachine()
+{
+	std::unique_ptr<VirtualMachine> vm = std::make_unique<VirtualMachine>(Bios::Type::GameBoy, true);
+
+	for (Address addr = 0xC000; addr < 0xE000; addr++)
+		vm->mmu.write(addr, static_cast<Byte>(addr * 0x9D + 0x5A));
+
+	vm->regs.PC = BENCH_PC;
+	vm->regs.SP = BENCH_SP;
+	vm->regs.BC = BENCH_BC;
+	vm->regs.DE = BENCH_DE;
+	vm->regs.HL = BENCH_HL;
+	vm->regs.A = 0x5A;
+	vm->regs.F = 0;
+	vm->ints.master = false;
+	vm->ints.enabled = 0;
+	vm->ints.flags = 0;
+	return vm;
+}
+
+static std::string HexName(const char* prefix, const unsigned int code, const std::string& name)
+{
+	char hex[4];
+	std::snprintf(hex, sizeof(hex), "%02X", code);
+	return std::string{ prefix } + hex + "." + name;
+}
+
+/* ns per call of fn, minus the cost of restoring the registers around it */
+template<typename _Fn>
+static f64 MeasureOpNanos(VirtualMachine& vm, const Registers& base, const f64 overhead, _Fn fn)
+{
+	const f64 seconds = MeasureSecondsPerCall([&]() { vm.regs = base; fn(); }, OPCODE_BENCH_SECONDS);
+	return max(seconds * 1e9 - overhead, 0.0);
+}
+
+static f64 MeasureRestoreNanos(VirtualMachine& vm, const Registers& base)
+{
+	return MeasureSecondsPerCall([&]() { vm.regs = base; }, OPCODE_BENCH_SECONDS) * 1e9;
+}
+
+
+static void BenchOpcodes(BenchmarkReport& report)
+{
+	std::unique_ptr<VirtualMachine> vm = MakeBenchMachine();
+	const Registers base = vm->regs;
+	const f64 overhead = MeasureRestoreNanos(*vm, base);
+
+	for (unsigned int code = 0; code < 256; code++)
+	{
+		const Opcode& op = Opcode::of(static_cast<Byte>(code));
+		if (op.name().empty())
+			continue;
+
+		const std::string name = HexName("opcode.", code, op.name());
+		if (!report.enabled(name))
+			continue;
+
+		f64 nanos;
+		switch (op.length())
+		{
+			default:
+			case 0:
+				nanos = MeasureOpNanos(*vm, base, overhead, [&]() { op(*vm); });
+				break;
+			case 1:
+				nanos = MeasureOpNanos(*vm, base, overhead, [&]() { op(*vm, static_cast<Byte>(BENCH_BYTE_OPERAND)); });
+				break;
+			case 2:
+				nanos = MeasureOpNanos(*vm, base, overhead, [&]() { op(*vm, static_cast<Word>(BENCH_WORD_OPERAND)); });
+				break;
+		}
+		report.add(name, nanos, "ns/op");
+
+		/* STOP, HALT, EI and friends leave state behind that the next opcode must not see */
+		vm->cpu.reset();
+		vm->ints.master = false;
+		vm->ints.enableDelay = 0;
+		vm->ints.flags = 0;
+	}
+}
+
+/* One register and the (HL) form of every CB group */
+static void BenchExtendedOpcodes(BenchmarkReport& report)
+{
+	static const char* const groups[] { "rlc", "rrc", "rl", "rr", "sla", "sra", "swap", "srl" };
+
+	std::unique_ptr<VirtualMachine> vm = MakeBenchMachine();
+	const Registers base = vm->regs;
+	const f64 overhead = MeasureRestoreNanos(*vm, base);
+
+	const auto bench = [&](const std::string& group, const Byte code)
+	{
+		const std::string reg = group + ".b";
+		const std::string hlp = group + ".hlp";
+		if (report.enabled("cb." + reg))
+			report.add("cb." + reg, MeasureOpNanos(*vm, base, overhead, [&]() { ExtendedOpcode::execute(*vm, code); }), "ns/op");
+		if (report.enabled("cb." + hlp))
+			report.add("cb." + hlp, MeasureOpNanos(*vm, base, overhead, [&]() { ExtendedOpcode::execute(*vm, static_cast<Byte>(code | 0x06)); }), "ns/op");
+	};
+
+	for (unsigned int i = 0; i < 8; i++)
+		bench(groups[i], static_cast<Byte>(i * 8));
+	bench("bit", 0x40 | (3 * 8));
+	bench("res", 0x80 | (3 * 8));
+	bench("set", 0xC0 | (3 * 8));
+}
+
+/* The whole fetch, decode, dispatch and tick accounting path, on a stream of opcodes in work RAM */
+static void BenchDispatch(BenchmarkReport& report, const std::string& name, const Byte opcode)
+{
+	if (!report.enabled(name))
+		return;
+
+	std::unique_ptr<VirtualMachine> vm = MakeBenchMachine();
+	for (Address addr = BENCH_PC; addr < 0xD000; addr++)
+		vm->mmu.write(addr, opcode);
+
+	const f64 seconds = MeasureSecondsPerCall([&]()
+	{
+		if (vm->regs.PC >= 0xD000)
+			vm->regs.PC = BENCH_PC;
+		Opcode::executeNext(*vm);
+	});
+	report.add(name, seconds * 1e9, "ns/op");
+}
+
+static void BenchRead(BenchmarkReport& report, const std::string& region, VirtualMachine& vm, const Address addr)
+{
+	const std::string name = "mmu.read." + region;
+	if (!report.enabled(name))
+		return;
+
+	const f64 seconds = MeasureSecondsPerCall([&]() { BenchSink = vm.mmu.read(addr); });
+	report.add(name, seconds * 1e9, "ns/op");
+}
+
+static void BenchWrite(BenchmarkReport& report, const std::string& region, VirtualMachine& vm, const Address addr, const Byte value)
+{
+	const std::string name = "mmu.write." + region;
+	if (!report.enabled(name))
+		return;
+
+	const f64 seconds = MeasureSecondsPerCall([&]() { vm.mmu.write(addr, value); });
+	report.add(name, seconds * 1e9, "ns/op");
+}
+
+static void BenchMemory(BenchmarkReport& report)
+{
+	static const Byte rom[0x8000] {};
+
+	std::unique_ptr<VirtualMachine> vm = MakeBenchMachine();
+	vm->mmu.loadRom(rom, sizeof(rom));
+
+	BenchRead(report, "rom0", *vm, 0x1234);
+	BenchRead(report, "romx", *vm, 0x5678);
+	BenchRead(report, "vram", *vm, 0x8800);
+	BenchRead(report, "wram", *vm, 0xC123);
+	BenchRead(report, "echo", *vm, 0xE123);
+	BenchRead(report, "oam", *vm, 0xFE10);
+	BenchRead(report, "io", *vm, 0xFF47);
+	BenchRead(report, "hram", *vm, 0xFF90);
+	BenchRead(report, "ie", *vm, 0xFFFF);
+
+	BenchWrite(report, "rom", *vm, 0x2000, 0x01);
+	BenchWrite(report, "vram", *vm, 0x8800, 0x3C);
+	BenchWrite(report, "wram", *vm, 0xC123, 0x3C);
+	BenchWrite(report, "echo", *vm, 0xE123, 0x3C);
+	BenchWrite(report, "oam", *vm, 0xFE10, 0x3C);
+	BenchWrite(report, "io", *vm, 0xFF47, 0xE4);
+	BenchWrite(report, "hram", *vm, 0xFF90, 0x3C);
+	BenchWrite(report, "ie", *vm, 0xFFFF, 0x00);
+
+	if (report.enabled("mmu.read_word.wram"))
+	{
+		const f64 seconds = MeasureSecondsPerCall([&]() { BenchSink = vm->mmu.readWord(0xC124); });
+		report.add("mmu.read_word.wram", seconds * 1e9, "ns/op");
+	}
+}
+
+static void BenchStack(BenchmarkReport& report)
+{
+	std::unique_ptr<VirtualMachine> vm = MakeBenchMachine();
+
+	if (report.enabled("stack.push_pop_word"))
+	{
+		const f64 seconds = MeasureSecondsPerCall([&]() { vm->stack.pushWord(0x1234); BenchSink = vm->stack.popWord(); });
+		report.add("stack.push_pop_word", seconds * 1e9, "ns/op");
+	}
+
+	if (report.enabled("stack.push_pop_byte"))
+	{
+		const f64 seconds = MeasureSecondsPerCall([&]() { vm->stack.pushByte(0x12); BenchSink = vm->stack.popByte(); });
+		report.add("stack.push_pop_byte", seconds * 1e9, "ns/op");
+	}
+}
+
+/* Request and dispatch to the vector, alone and followed by RETI */
+static void BenchInterrupts(BenchmarkReport& report)
+{
+	std::unique_ptr<VirtualMachine> vm = MakeBenchMachine();
+	const Registers base = vm->regs;
+	const f64 overhead = MeasureRestoreNanos(*vm, base);
+
+	vm->ints.enabled = static_cast<u8>(Interrupt::Timer);
+
+	if (report.enabled("interrupt.dispatch"))
+	{
+		const f64 nanos = MeasureOpNanos(*vm, base, overhead, [&]()
+		{
+			vm->ints.master = true;
+			vm->ints.request(Interrupt::Timer);
+			vm->ints.dispatch(*vm);
+		});
+		report.add("interrupt.dispatch", nanos, "ns/op");
+	}
+
+	if (report.enabled("interrupt.dispatch_reti"))
+	{
+		const f64 nanos = MeasureOpNanos(*vm, base, overhead, [&]()
+		{
+			vm->ints.request(Interrupt::Timer);
+			vm->ints.dispatch(*vm);
+			vm->ints.returnFromInterrupt(*vm);
+		});
+		report.add("interrupt.dispatch_reti", nanos, "ns/op");
+	}
+}
+
+void RunCpuBenchmarks(BenchmarkReport& report)
+{
+	BenchOpcodes(report);
+	BenchExtendedOpcodes(report);
+	BenchDispatch(report, "cpu.dispatch.nop", 0x00);
+	BenchDispatch(report, "cpu.dispatch.inc_a", 0x3C);
+	BenchInterrupts(report);
+}
+
+void RunMemoryBenchmarks(BenchmarkReport& report)
+{
+	BenchMemory(report);
+	BenchStack(report);
+}
@@ -0,0 +1,15 @@
+#include "bench.h"
+
+
+int main(int argc, char** argv)
+{
+	BenchmarkReport report{ argc > 1 ? argv[1] : "" };
+
+	RunScalerBenchmarks(report);
+	RunResamplerBenchmarks(report);
+	RunCpuBenchmarks(report);
+	RunMemoryBenchmarks(report);
+
+	report.print(std::cout);
+	return 0;
+}
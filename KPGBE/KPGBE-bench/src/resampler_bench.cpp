@@ -0,0 +1,48 @@
+#include "bench.h"
+
+#include "resampler.h"
+
+#define BENCH_SECONDS 1
+
+
+/* Square waves at a few pitches, close to what the APU produces */
+static void FillTestSignal(std::vector<s16>& samples, const unsigned int rate)
+{
+	samples.resize(static_cast<size_t>(rate) * BENCH_SECONDS * 2);
+	for (size_t i = 0; i < samples.size() / 2; i++)
+	{
+		const s16 left = ((i * 440 * 2 / rate) & 0x1) ? 4000 : -4000;
+		const s16 right = ((i * 659 * 2 / rate) & 0x1) ? 3000 : -3000;
+		samples[i * 2] = left;
+		samples[i * 2 + 1] = static_cast<s16>(right + left / 2);
+	}
+}
+
+static void BenchResampler(BenchmarkReport& report, const std::string& name, const unsigned int inputRate,
+	const unsigned int outputRate, const unsigned int channels, const ResamplerQuality quality)
+{
+	if (!report.enabled(name))
+		return;
+
+	std::vector<s16> input;
+	FillTestSignal(input, inputRate);
+
+	Resampler resampler;
+	resampler.configure(inputRate, outputRate, channels, quality);
+
+	const size_t frames = input.size() / 2;
+	std::vector<s16> output(resampler.maxOutputFrames(frames) * channels);
+
+	const f64 seconds = MeasureSecondsPerCall([&]() { resampler.process(input.data(), frames, output.data()); });
+	report.add(name, BENCH_SECONDS / seconds, "x realtime");
+}
+
+void RunResamplerBenchmarks(BenchmarkReport& report)
+{
+	BenchResampler(report, "resampler.fast.44100to48000", 44100, 48000, 2, ResamplerQuality::Fast);
+	BenchResampler(report, "resampler.balanced.44100to48000", 44100, 48000, 2, ResamplerQuality::Balanced);
+	BenchResampler(report, "resampler.best.44100to48000", 44100, 48000, 2, ResamplerQuality::Best);
+	BenchResampler(report, "resampler.balanced.48000to44100", 48000, 44100, 2, ResamplerQuality::Balanced);
+	BenchResampler(report, "resampler.balanced.32768to44100", 32768, 44100, 2, ResamplerQuality::Balanced);
+	BenchResampler(report, "resampler.balanced.48000to32000mono", 48000, 32000, 1, ResamplerQuality::Balanced);
+}
@@ -0,0 +1,57 @@
+#include "bench.h"
+
+#include "ppu.h"
+#include "scaler.h"
+
+
+/* Tile-like content: flat areas with hard edges, the usual case for the filters */
+static void FillTestFrame(RGBA* frame)
+{
+	static const RGBA shades[4] {
+		{ 0xE0, 0xF8, 0xD0, 0xFF },
+		{ 0x88, 0xC0, 0x70, 0xFF },
+		{ 0x34, 0x68, 0x56, 0xFF },
+		{ 0x08, 0x18, 0x20, 0xFF }
+	};
+
+	u32 seed = 0x12345678;
+	for (unsigned int y = 0; y < SCREEN_HEIGHT; y++)
+	{
+		for (unsigned int x = 0; x < SCREEN_WIDTH; x++)
+		{
+			seed = seed * 1664525U + 1013904223U;
+			const unsigned int tile = ((x / 8) + (y / 8) * 3) & 0x3;
+			frame[y * SCREEN_WIDTH + x] = shades[(seed >> 28) < 3 ? (tile + 1) & 0x3 : tile];
+		}
+	}
+}
+
+static void BenchFilter(BenchmarkReport& report, const std::string& name, const ScaleFilter filter, const unsigned int factor)
+{
+	if (!report.enabled(name))
+		return;
+
+	static RGBA frame[SCREEN_WIDTH * SCREEN_HEIGHT];
+	FillTestFrame(frame);
+
+	Scaler scaler;
+	scaler.setFilter(filter, factor);
+
+	const unsigned int width = scaler.outputWidth(SCREEN_WIDTH);
+	const unsigned int height = scaler.outputHeight(SCREEN_HEIGHT);
+	std::vector<RGBA> output(static_cast<size_t>(width) * height);
+
+	const f64 seconds = MeasureSecondsPerCall([&]() { scaler.apply(frame, SCREEN_WIDTH, SCREEN_HEIGHT, output.data(), width); });
+	report.add(name, static_cast<f64>(width) * height / seconds / 1e6, "Mpixel/s");
+}
+
+void RunScalerBenchmarks(BenchmarkReport& report)
+{
+	BenchFilter(report, "scaler.nearest1x", ScaleFilter::Nearest, 1);
+	BenchFilter(report, "scaler.nearest2x", ScaleFilter::Nearest, 2);
+	BenchFilter(report, "scaler.nearest3x", ScaleFilter::Nearest, 3);
+	BenchFilter(report, "scaler.nearest4x", ScaleFilter::Nearest, 4);
+	BenchFilter(report, "scaler.scale2x", ScaleFilter::Scale2x, 2);
+	BenchFilter(report, "scaler.scale3x", ScaleFilter::Scale3x, 3);
+	BenchFilter(report, "scaler.edgeblend2x", ScaleFilter::EdgeBlend2x, 2);
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include "common.h"
+#include "blip.h"
+#include "audio.h"
+#include "rate_control.h"
+
+#define APU_CLOCK_RATE 4194304
+#define APU_DEFAULT_SAMPLE_RATE 44100
+#define APU_CHANNELS 4
+#define APU_REGISTERS 0x30
+#define APU_SEQUENCER_PERIOD 8192
+
+
+class VirtualMachine;
+class StateWriter;
+class StateReader;
+
+/* Sound unit. Channels are never sampled: every change of a channel output is
+ * written as an amplitude delta at its exact tick into two band-limited step
+ * buffers (left/right), which produce the PCM output on demand.
+ * The unit is lazy; it only catches up with the CPU when a sound register is
+ * accessed, when the frame sequencer event fires or when samples are read. */
+class APU
+{
+private:
+	struct Channel
+	{
+		bool enabled;
+		u16 length;
+		u8 volume;
+		u8 envelopeTimer;
+		u32 timer;
+		u8 position;
+		u8 level;
+		s32 left;
+		s32 right;
+	};
+
+private:
+	Byte _regs[APU_REGISTERS];
+	bool _power;
+
+	Channel _channels[APU_CHANNELS];
+
+	u16 _sweepFrequency;
+	u8 _sweepTimer;
+	bool _sweepEnabled;
+	u16 _lfsr;
+
+	unsigned int _sequencerStep;
+
+	Ticks _lastTicks;
+	u32 _frameTime;
+
+	unsigned int _sampleRate;
+	BlipBuffer _left;
+	BlipBuffer _right;
+
+	AudioSink* _sink;
+	bool _rateControlEnabled;
+	RateControl _rateControl;
+
+public:
+	/* A headless APU runs the channels but synthesizes no samples */
+	APU(const bool headless = false);
+	APU(const APU&) = default;
+	~APU();
+
+	APU& operator= (const APU&) = default;
+
+	void reset();
+
+	void saveState(StateWriter& state) const;
+	void loadState(StateReader& state);
+
+	/* The channels of the source; pending samples and the sink are not copied */
+	void copyState(const APU& source);
+
+	/* Runs the channels up to the current tick */
+	void step(VirtualMachine& vm);
+
+	/* Scheduler callback, every APU_SEQUENCER_PERIOD ticks */
+	void sequencerEvent(VirtualMachine& vm, const Ticks when);
+
+	void setSampleRate(const unsigned int rate);
+	inline unsigned int sampleRate() const { return _sampleRate; }
+
+	/* With a sink attached, samples are pushed to it at the end of every APU frame
+	 * (and on flush); whatever does not fit in the sink is dropped */
+	bool setAudioSink(AudioSink* sink);
+	inline AudioSink* audioSink() const { return _sink; }
+
+	void flush(VirtualMachine& vm);
+
+	/* Adjusts the output rate to keep a buffered sink at its target fill level */
+	void setRateControlEnabled(const bool enabled);
+	inline bool isRateControlEnabled() const { return _rateControlEnabled; }
+	inline RateControl& rateControl() { return _rateControl; }
+	inline const RateControl& rateControl() const { return _rateControl; }
+
+	Byte readRegister(VirtualMachine& vm, const Address addr);
+	void writeRegister(VirtualMachine& vm, const Address addr, const Byte value);
+
+	/* Interleaved stereo, up to the current tick; returns the number of frames (sample pairs) written */
+	size_t readSamples(VirtualMachine& vm, s16* out, const size_t frames);
+
+	/* Frames readSamples could return right now, without catching up */
+	inline size_t samplesAvailable() const { return _left.samplesAvailable(); }
+
+private:
+	void run(const Ticks to);
+	void runChannel(const unsigned int channel, const u32 from, const u32 to);
+	void endFrame();
+	void deliver();
+	void applyRateRatio(const f64 ratio);
+
+	void clockSequencer();
+	void clockSweep();
+	u16 sweepTarget();
+
+	void trigger(const unsigned int channel);
+	void disable(const unsigned int channel);
+
+	void setLevel(const unsigned int channel, const u32 time, const u8 level);
+	u8 currentLevel(const unsigned int channel) const;
+	u32 period(const unsigned int channel) const;
+	bool dacEnabled(const unsigned int channel) const;
+
+	inline Byte& reg(const unsigned int channel, const unsigned int index) { return _regs[channel * 5 + index]; }
+	inline Byte reg(const unsigned int channel, const unsigned int index) const { return _regs[channel * 5 + index]; }
+};
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "common.h"
+
+
+/* Frontend side of the audio output. The APU synthesizes interleaved stereo
+ * samples straight into the buffer returned by lockSamples; sinks with another
+ * channel count are fed through a ResamplingSink. */
+class AudioSink
+{
+public:
+	virtual ~AudioSink() = default;
+
+	virtual unsigned int sampleRate() const = 0;
+	virtual unsigned int channels() const { return 2; }
+
+	/* Returns room for up to frames frames (of channels() samples each) and
+	 * updates frames with the room actually given (0 when the sink is full) */
+	virtual s16* lockSamples(size_t& frames) = 0;
+	virtual void unlockSamples(const size_t frames) = 0;
+
+	/* Buffered sinks report their fill level so the APU can run rate control; 0 capacity opts out */
+	virtual size_t bufferedFrames() const { return 0; }
+	virtual size_t capacityFrames() const { return 0; }
+};
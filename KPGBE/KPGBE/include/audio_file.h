@@ -0,0 +1,87 @@
+#pragma once
+
+#include "common.h"
+#include "audio.h"
+#include "spsc.h"
+
+#include <fstream>
+#include <thread>
+#include <vector>
+
+#define AUDIO_FILE_CHUNK_SAMPLES 0x20000
+#define AUDIO_FILE_CHUNKS 8
+
+/* empty polls before the writer starts sleeping between polls */
+#define AUDIO_FILE_IDLE_SPINS 64
+#define AUDIO_FILE_IDLE_SLEEP_MICROS 500
+
+
+class VirtualMachine;
+
+/* Hash stores nothing; it only records a hash of the samples of every frame */
+enum class AudioFileFormat { Wav, Raw, Hash };
+
+
+/* Headless audio sink. The APU synthesizes straight into large chunks which a
+ * background thread writes to disk, so the emulation thread never waits on I/O
+ * unless every chunk is still queued. Output is 16 bit little endian stereo. */
+class AudioFileSink : public AudioSink
+{
+private:
+	struct ChunkRef
+	{
+		u32 index;
+		u32 samples;
+	};
+
+private:
+	unsigned int _sampleRate;
+	AudioFileFormat _format;
+	bool _open;
+
+	std::fstream _file;
+	u64 _bytesWritten;
+
+	s16* _storage;
+	u32 _current;
+	u32 _used;
+	SPSCRing<ChunkRef> _queued;
+	SPSCRing<u32> _free;
+
+	std::thread _writer;
+	std::atomic<bool> _running;
+	std::atomic<bool> _failed;
+
+	u64 _frameHash;
+	std::vector<u64> _frameHashes;
+
+public:
+	AudioFileSink(const unsigned int sampleRate);
+	AudioFileSink(const AudioFileSink&) = delete;
+	~AudioFileSink();
+
+	AudioFileSink& operator= (const AudioFileSink&) = delete;
+
+	bool open(const char* filename, const AudioFileFormat format);
+	void openHash();
+	bool close();
+
+	inline bool isOpen() const { return _open; }
+	inline AudioFileFormat format() const { return _format; }
+
+	/* Ends the current frame: the APU of the machine (whose sink this is) is flushed, so
+	 * every sample up to now is in, and the hash is appended to frameHashes. Call after
+	 * every runFrame(). Hash format only. */
+	void markFrame(VirtualMachine& vm);
+	inline const std::vector<u64>& frameHashes() const { return _frameHashes; }
+
+	unsigned int sampleRate() const override;
+
+	s16* lockSamples(size_t& frames) override;
+	void unlockSamples(const size_t frames) override;
+
+private:
+	void submit();
+	void writeLoop();
+	void writeHeader(const u32 dataBytes);
+};
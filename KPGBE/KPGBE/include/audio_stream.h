@@ -0,0 +1,54 @@
+#pragma once
+
+#include "common.h"
+#include "audio.h"
+#include "spsc.h"
+
+#include <SFML/Audio/SoundStream.hpp>
+
+#define AUDIO_STREAM_CAPACITY 0x4000
+#define AUDIO_STREAM_CHUNK 0x800
+#define AUDIO_STREAM_MIN_CHUNK 0x100
+
+
+/* Plays the APU output through SFML. Emulation and the SFML audio thread only
+ * share a lock-free ring of interleaved samples: the APU writes into ring
+ * memory and SFML is handed pointers into it, so no sample is ever copied and
+ * the audio thread never waits on the emulation. */
+class AudioStream : public sf::SoundStream, public AudioSink
+{
+private:
+	SPSCRing<s16> _ring;
+	unsigned int _sampleRate;
+
+	size_t _pending;
+	s16 _silence[AUDIO_STREAM_MIN_CHUNK];
+
+	std::atomic<u64> _underruns;
+	std::atomic<u64> _overruns;
+
+public:
+	AudioStream(const unsigned int sampleRate, const size_t capacity = AUDIO_STREAM_CAPACITY);
+	AudioStream(const AudioStream&) = delete;
+	~AudioStream();
+
+	AudioStream& operator= (const AudioStream&) = delete;
+
+	unsigned int sampleRate() const override;
+
+	s16* lockSamples(size_t& frames) override;
+	void unlockSamples(const size_t frames) override;
+
+	/* Times the audio thread found the ring (almost) empty and played silence */
+	inline u64 underruns() const { return _underruns.load(std::memory_order_relaxed); }
+
+	/* Times the APU found the ring full and had to drop samples */
+	inline u64 overruns() const { return _overruns.load(std::memory_order_relaxed); }
+
+	inline size_t bufferedFrames() const override { return _ring.size() / 2; }
+	inline size_t capacityFrames() const override { return _ring.capacity() / 2; }
+
+protected:
+	bool onGetData(Chunk& data) override;
+	void onSeek(sf::Time timeOffset) override;
+};
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "common.h"
+
+#include <vector>
+
+#define BLIP_BUFFER_SIZE 0x2000
+#define BLIP_PHASE_BITS 5
+#define BLIP_PHASES (0x1 << BLIP_PHASE_BITS)
+#define BLIP_HALF_WIDTH 8
+#define BLIP_WIDTH (BLIP_HALF_WIDTH * 2)
+#define BLIP_DELTA_BITS 15
+#define BLIP_BASS_SHIFT 9
+#define BLIP_TIME_BITS 32
+
+
+/* Band-limited step buffer. Sources only report amplitude changes at the exact
+ * clock they happen; each change is spread over BLIP_WIDTH output samples with
+ * a windowed sinc step, and reading integrates the deltas into PCM samples.
+ * Times are clocks relative to the start of the current frame. */
+class BlipBuffer
+{
+private:
+	u64 _factor;
+	u64 _offset;
+	s32 _integrator;
+
+	size_t _capacity;
+	std::vector<s32> _samples;
+
+public:
+	/* A headless buffer has no room at all: deltas are dropped and reads are silent */
+	BlipBuffer(const bool headless = false);
+	BlipBuffer(const BlipBuffer&) = default;
+
+	BlipBuffer& operator= (const BlipBuffer&) = default;
+
+	void setRates(const f64 clockRate, const f64 sampleRate);
+	void clear();
+
+	inline void addDelta(const u32 time, const s32 delta)
+	{
+		const u64 position = _offset + time * _factor;
+		const size_t index = static_cast<size_t>(position >> BLIP_TIME_BITS);
+		if (delta == 0 || index >= _capacity)
+			return;
+
+		const s16* kernel = Kernel[(position >> (BLIP_TIME_BITS - BLIP_PHASE_BITS)) & (BLIP_PHASES - 1)];
+		s32* out = _samples.data() + index;
+		for (unsigned int i = 0; i < BLIP_WIDTH; i++)
+			out[i] += kernel[i] * delta;
+	}
+
+	/* Makes the samples up to the given time readable and starts a new frame */
+	void endFrame(const u32 time);
+
+	inline size_t samplesAvailable() const { return static_cast<size_t>(_offset >> BLIP_TIME_BITS); }
+
+	/* Writes up to count samples, stride apart (2 for interleaved stereo); out may be nullptr to drop them */
+	size_t readSamples(s16* out, const size_t count, const size_t stride);
+
+private:
+	static const s16 (&Kernel)[BLIP_PHASES][BLIP_WIDTH];
+};
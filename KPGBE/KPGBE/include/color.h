@@ -0,0 +1,75 @@
+#pragma once
+
+#include "common.h"
+
+#define RGB555_COLORS 0x8000U
+#define PALETTE_COUNT 8
+#define PALETTE_COLORS 4
+#define PALETTE_RAM_SIZE (PALETTE_COUNT * PALETTE_COLORS * 2)
+
+class StateWriter;
+class StateReader;
+
+typedef u16 RGB555;
+
+
+enum class ColorCorrection { None, GameBoyColorLCD, GameBoyAdvanceLCD };
+
+
+class ColorTable
+{
+public:
+	/* Returns the 32768 entries RGB555 -> RGBA table of a correction profile.
+	 * Tables are built once, on first use, and shared by every PPU. */
+	static const RGBA* of(const ColorCorrection correction);
+
+	static RGBA convert(const RGB555 color, const ColorCorrection correction);
+};
+
+
+/* GBC palette memory (BCPS/BCPD or OCPS/OCPD pair) with a cache of the
+ * 8x4 colors already resolved through the current ColorTable. */
+class ColorPalettes
+{
+private:
+	Byte _ram[PALETTE_RAM_SIZE];
+	Byte _index;
+	bool _autoIncrement;
+
+	const RGBA* _table;
+	RGBA _cache[PALETTE_COUNT][PALETTE_COLORS];
+	u8 _dirty;
+	u32 _generation;
+
+public:
+	ColorPalettes();
+	ColorPalettes(const ColorPalettes&) = default;
+
+	ColorPalettes& operator= (const ColorPalettes&) = default;
+
+	void reset();
+
+	void saveState(StateWriter& state) const;
+	void loadState(StateReader& state);
+
+	void setColorTable(const RGBA* table);
+
+	Byte readSpecification() const;
+	void writeSpecification(const Byte value);
+
+	Byte readData() const;
+	void writeData(const Byte value);
+
+	/* Changes every time a resolved color may have changed */
+	inline u32 generation() const { return _generation; }
+
+	inline const RGBA* palette(const unsigned int index)
+	{
+		if (_dirty & (0x1U << index))
+			resolve(index);
+		return _cache[index];
+	}
+
+private:
+	void resolve(const unsigned int index);
+};
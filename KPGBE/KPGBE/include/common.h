@@ -6,6 +6,10 @@
 #include <algorithm>
 #include <cstdio>
 
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
 
 #define OK true
 #define ERROR false
@@ -88,6 +92,27 @@ struct JoypadButtons
 {
 	bool down, up, left, right;
 	bool start, select, B, A;
+
+	/* Pressed buttons as P1 bits: right, left, up, down, A, B, select, start */
+	inline Byte mask() const
+	{
+		return static_cast<Byte>(right | (left << 1) | (up << 2) | (down << 3) |
+			(A << 4) | (B << 5) | (select << 6) | (start << 7));
+	}
+
+	static inline JoypadButtons fromMask(const Byte mask)
+	{
+		JoypadButtons buttons;
+		buttons.right = (mask & 0x01) != 0;
+		buttons.left = (mask & 0x02) != 0;
+		buttons.up = (mask & 0x04) != 0;
+		buttons.down = (mask & 0x08) != 0;
+		buttons.A = (mask & 0x10) != 0;
+		buttons.B = (mask & 0x20) != 0;
+		buttons.select = (mask & 0x40) != 0;
+		buttons.start = (mask & 0x80) != 0;
+		return buttons;
+	}
 };
 
 struct FileData
@@ -133,9 +158,27 @@ constexpr _Ty align_down(const _Ty x, const _Ty align) { return (x & ~(align - 1
 template<typename _Ty>
 constexpr _Ty is_aligned(const _Ty x, const _Ty align) { return (x & (align - 1)) == 0; }
 
+/* x must not be 0 */
+inline unsigned int count_trailing_zeros(const u32 x)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, x);
+	return static_cast<unsigned int>(index);
+#else
+	return static_cast<unsigned int>(__builtin_ctz(x));
+#endif
+}
+
 std::string ByteToHexString(const Byte value);
 std::string WordToHexString(const Word value);
 std::string SizeToHexString(const size_t value);
 std::string AddressToHexString(const Address value);
 
 std::ostream& DumpBytesToStream(std::ostream& os, const void* mem, const size_t size, size_t bytesPerRow = 0x10);
+
+#define FNV_OFFSET_BASIS 0xCBF29CE484222325ULL
+#define FNV_PRIME 0x100000001B3ULL
+
+/* 64-bit FNV-1a taken a word at a time: quick to compute, only for comparing data */
+u64 HashBytes(const void* data, const size_t size);
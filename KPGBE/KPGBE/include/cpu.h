@@ -3,25 +3,57 @@
 #include "common.h"
 
 class VirtualMachine;
+class StateWriter;
+class StateReader;
 
+/* Ticks are the real (single speed) 4 MHz clock every other component and the scheduler
+ * run on. In GBC double speed mode an instruction takes half as many ticks, and
+ * cycles() counts the CPU clock itself for the components that follow it (the timer). */
 class CPU
 {
 private:
 	bool _stop;
+	bool _halted;
+	bool _haltBug;
+	bool _speedSwitch;
+	unsigned int _speedShift;
 	Ticks _ticks;
+	Ticks _tickBase;
+	Ticks _cycleBase;
 
 public:
 	CPU();
 	~CPU();
 
-	void step(VirtualMachine& vm);
+	/* Runs one instruction (or one halted interval, never past limit); defined in vm.h
+	 * so the run loop gets it inlined */
+	inline void step(VirtualMachine& vm, const Ticks limit = INVALID_TICKS);
 
 	void reset();
 
-	void stop();
+	void saveState(StateWriter& state) const;
+	void loadState(StateReader& state);
+
+	/* STOP: switches speed when armed through KEY1, otherwise stops the CPU */
+	void stop(VirtualMachine& vm);
 	bool isStopped() const;
 
-	inline void increaseTicks(unsigned int ticks) { _ticks += static_cast<Ticks>(ticks); }
-	inline void decreaseTicks(unsigned int ticks) { _ticks -= static_cast<Ticks>(ticks); }
+	inline bool isDoubleSpeed() const { return _speedShift != 0; }
+	inline Byte readSpeedRegister() const { return 0x7E | static_cast<Byte>(_speedShift << 7) | (_speedSwitch ? 0x1 : 0x0); }
+	inline void writeSpeedRegister(const Byte value) { _speedSwitch = (value & 0x1) != 0; }
+
+	void halt(VirtualMachine& vm);
+	inline bool isHalted() const { return _halted; }
+
+	/* amounts are CPU cycles */
+	inline void increaseTicks(unsigned int ticks) { _ticks += static_cast<Ticks>(ticks >> _speedShift); }
+	inline void decreaseTicks(unsigned int ticks) { _ticks -= static_cast<Ticks>(ticks >> _speedShift); }
 	inline Ticks ticks() const { return _ticks; }
+
+	inline Ticks cycles() const { return ticksToCycles(_ticks); }
+	inline Ticks ticksToCycles(const Ticks ticks) const { return _cycleBase + ((ticks - _tickBase) << _speedShift); }
+	inline Ticks cyclesToTicks(const Ticks cycles) const
+	{
+		return _tickBase + ((cycles - _cycleBase + (static_cast<Ticks>(1) << _speedShift) - 1) >> _speedShift);
+	}
 };
@@ -2,12 +2,27 @@
 
 #include "common.h"
 
+#define INTERRUPT_MASK 0x1F
+
 
 class VirtualMachine;
+class StateWriter;
+class StateReader;
+
+/* Bit of each interrupt in IE/IF; lower bits have higher priority */
+enum class Interrupt : u8
+{
+	VBlank = 0x01,
+	LCDStat = 0x02,
+	Timer = 0x04,
+	Serial = 0x08,
+	Joypad = 0x10
+};
 
 struct Interrupts
 {
 	bool master;
+	u8 enableDelay;
 	union
 	{
 		struct
@@ -41,15 +56,27 @@ public:
 
 	Interrupts& operator= (const Interrupts&) = default;
 
-	void step(VirtualMachine& vm);
-
 	void reset();
 
-	void vblank(VirtualMachine& vm);
-	void lcdstat(VirtualMachine& vm);
-	void timer(VirtualMachine& vm);
-	void serial(VirtualMachine& vm);
-	void joypad(VirtualMachine& vm);
+	void saveState(StateWriter& state) const;
+	void loadState(StateReader& state);
+
+	/* Requested and enabled interrupts (IE & IF), whether or not IME is set */
+	inline u8 pending() const { return enabled & flags & INTERRUPT_MASK; }
+	inline void request(const Interrupt interrupt) { flags |= static_cast<u8>(interrupt); }
+
+	/* EI takes effect after the instruction that follows it */
+	inline void enable() { if (!master && !enableDelay) enableDelay = 2; }
+	inline void disable() { master = false; enableDelay = 0; }
+
+	/* Called once after every instruction */
+	inline void instructionDone() { if (enableDelay && --enableDelay == 0) master = true; }
+
+	/* Services the highest priority pending interrupt; only valid when master && pending() */
+	void dispatch(VirtualMachine& vm);
 
 	void returnFromInterrupt(VirtualMachine& vm);
+
+	inline Byte readFlags() const { return 0xE0 | flags; }
+	inline void writeFlags(const Byte value) { flags = value & INTERRUPT_MASK; }
 };
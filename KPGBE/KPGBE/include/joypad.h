@@ -0,0 +1,65 @@
+#pragma once
+
+#include "common.h"
+
+#include <deque>
+
+
+class VirtualMachine;
+class StateWriter;
+class StateReader;
+
+/* P1 and the input queue. Button changes are queued with the tick they take effect
+ * at and applied by a scheduler event, so the same inputs always reach the game at
+ * the same instruction no matter how the frontend batches them. A button press on
+ * a selected line raises the joypad interrupt. */
+class Joypad
+{
+private:
+	struct Input
+	{
+		Ticks when;
+		Byte buttons;
+	};
+
+private:
+	Byte _select;
+	Byte _buttons;
+	std::deque<Input> _queue;
+
+public:
+	Joypad();
+	Joypad(const Joypad&) = default;
+
+	Joypad& operator= (const Joypad&) = default;
+
+	void reset();
+
+	void saveState(StateWriter& state) const;
+	void loadState(StateReader& state);
+
+	/* Only the buttons and selected lines: the queue belongs to the frontend */
+	void copyState(const Joypad& source);
+
+	Byte readRegister() const;
+	void writeRegister(VirtualMachine& vm, const Byte value);
+
+	/* Applies the buttons at the given tick; a tick already passed applies on the next
+	 * instruction. Inputs for the same tick apply in the order they were queued. */
+	void queue(VirtualMachine& vm, const Ticks when, const JoypadButtons& buttons);
+
+	/* Applies the buttons now, dropping nothing from the queue */
+	void press(VirtualMachine& vm, const JoypadButtons& buttons);
+
+	void clearQueue(VirtualMachine& vm);
+	inline size_t queued() const { return _queue.size(); }
+
+	inline JoypadButtons buttons() const { return JoypadButtons::fromMask(_buttons); }
+
+	void schedule(VirtualMachine& vm) const;
+	void inputEvent(VirtualMachine& vm, const Ticks when);
+
+private:
+	void apply(VirtualMachine& vm, const Byte select, const Byte buttons);
+	Byte lines(const Byte select, const Byte buttons) const;
+};
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "common.h"
+
+#include <condition_variable>
+#include <mutex>
+
+#define LINK_SIDES 2
+
+
+class VirtualMachine;
+
+/* Connects the serial ports of two machines, each normally run by its own thread.
+ * The machines run freely and only meet at transfer boundaries: the side driving
+ * the clock posts its byte when the transfer starts. If the other side is already
+ * listening with the external clock the bytes are exchanged at once and it picks
+ * its byte up on its next poll; otherwise the sender, at the end of the transfer,
+ * waits until the other side has either started listening or run past the end of
+ * the transfer without listening (0xFF is received).
+ * Clocks are compared through the skew between the machines measured at the last
+ * exchange, so a side that happens to be ahead in emulated time is not taken for
+ * one that missed the transfer.
+ * Both sides must keep running while connected, or the other one may block: a
+ * thread that stops running its machine closes the cable first. */
+class LinkCable
+{
+private:
+	struct Side
+	{
+		VirtualMachine* vm;
+		Ticks clock;
+
+		bool listening;
+		bool delivered;
+		bool sending;
+		bool answered;
+		Byte data;
+		Byte answer;
+		Byte received;
+		Ticks end;
+	};
+
+private:
+	mutable std::mutex _mutex;
+	std::condition_variable _changed;
+	Side _sides[LINK_SIDES];
+	s64 _skew;
+	bool _closed;
+
+public:
+	LinkCable();
+	LinkCable(const LinkCable&) = delete;
+	~LinkCable();
+
+	LinkCable& operator= (const LinkCable&) = delete;
+
+	/* Neither machine may be running while connecting or disconnecting */
+	void connect(VirtualMachine& a, VirtualMachine& b);
+	void disconnect();
+
+	/* Unplugs the cable without detaching the ports: nothing blocks any more and every
+	 * transfer receives 0xFF. May be called from any thread while the machines run. */
+	void close();
+
+	inline bool isConnected() const { return _sides[0].vm != nullptr; }
+
+	/* The clock of the side jumped (a state was loaded): measures the skew again
+	 * against the last clock the other side published */
+	void resync(const unsigned int side, const Ticks now);
+
+	/* Serial port side */
+	void publish(const unsigned int side, const Ticks now);
+	void send(const unsigned int side, const Byte data, const Ticks now, const Ticks end);
+	Byte receive(const unsigned int side, const Ticks now);
+	bool listen(const unsigned int side, const Byte data, const Ticks now, Byte& received);
+	void cancel(const unsigned int side);
+
+private:
+	void exchange(const unsigned int sender);
+
+	/* The clock of the other side, in the time of the given side */
+	inline s64 peerClock(const unsigned int side) const
+	{
+		const s64 clock = static_cast<s64>(_sides[side ^ 1].clock);
+		return side == 0 ? clock - _skew : clock + _skew;
+	}
+};
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "common.h"
+#include "save_state.h"
+
+#include <memory>
+#include <vector>
+
+#define LOCKSTEP_DEFAULT_MERGE_INTERVAL 4
+#define LOCKSTEP_MAX_MERGE_INTERVAL 256
+
+
+class VirtualMachine;
+enum class RunStatus : u8;
+
+/* Steps many instances of one machine a frame at a time. The machine is deterministic,
+ * so instances in the same state that hold the same buttons stay identical: they are
+ * kept as a group sharing a single headless machine, which runs the frame once for all
+ * of them. An instance whose buttons differ from the rest of its group splits off into
+ * a clone of it (copy-on-write, so a few KB), and every few steps groups that reached
+ * the same state again are merged back. Candidates for a merge are found through the
+ * registers and the clock, and their memory is compared (shared pages for free) before
+ * any state is serialized; passes that merge nothing back off up to a pass every
+ * LOCKSTEP_MAX_MERGE_INTERVAL steps. Instances that diverge for good cost what
+ * independent machines would, plus one split each.
+ * There is no SIMD path: every opcode runs on one whole machine (its MMU, PPU, APU),
+ * so instances are only ever shared whole, never executed as vector lanes.
+ * Per instance and per group state is kept in flat arrays indexed by instance and by
+ * group respectively. */
+class Lockstep
+{
+private:
+	struct Split
+	{
+		u32 group;
+		Byte buttons;
+		u32 to;
+	};
+
+private:
+	/* per instance */
+	std::vector<u32> _group;
+
+	/* per group; a null machine is a free slot */
+	std::vector<std::unique_ptr<VirtualMachine>> _machines;
+	std::vector<u32> _refs;
+	std::vector<u16> _claims;
+	std::vector<RunStatus> _status;
+	std::vector<SaveState> _states;
+	std::vector<u64> _keys;
+	std::vector<u8> _serialized;
+	std::vector<u32> _remap;
+
+	std::vector<u32> _free;
+	std::vector<Split> _splits;
+	std::vector<u32> _order;
+	size_t _live;
+
+	unsigned int _mergeInterval;
+	unsigned int _mergeWait;
+	u64 _nextMerge;
+	u64 _steps;
+	u64 _machineFrames;
+
+public:
+	/* Every instance starts as a copy of the source */
+	Lockstep(const VirtualMachine& source, const size_t instances);
+	Lockstep(const Lockstep&) = delete;
+	~Lockstep();
+
+	Lockstep& operator= (const Lockstep&) = delete;
+
+	void reset(const VirtualMachine& source);
+
+	/* Runs every instance until its next frame, holding buttons[instance] (a JoypadButtons mask) */
+	void step(const Byte* buttons);
+
+	inline size_t instances() const { return _group.size(); }
+	inline size_t groups() const { return _live; }
+	inline u32 group(const size_t instance) const { return _group[instance]; }
+
+	/* Shared with the rest of the group */
+	inline const VirtualMachine& machine(const size_t instance) const { return *_machines[_group[instance]]; }
+	inline RunStatus status(const size_t instance) const { return _status[_group[instance]]; }
+
+	/* Gives the instance a machine of its own, which may then be modified */
+	VirtualMachine& own(const size_t instance);
+
+	void setMergeInterval(const unsigned int steps);
+	inline unsigned int mergeInterval() const { return _mergeInterval; }
+
+	/* Steps taken, and frames actually emulated over all groups */
+	inline u64 steps() const { return _steps; }
+	inline u64 machineFrames() const { return _machineFrames; }
+
+private:
+	u32 split(const u32 group, const Byte buttons);
+	u32 add(std::unique_ptr<VirtualMachine> machine);
+	void release(const u32 group);
+
+	bool merge();
+	bool equal(const u32 a, const u32 b);
+
+	static u64 key(const VirtualMachine& vm);
+};
@@ -4,22 +4,62 @@
 #include "bios.h"
 #include "ram.h"
 
+#include <memory>
+#include <vector>
+
+
+class VirtualMachine;
+class StateWriter;
+class StateReader;
 
 class MMU
 {
 private:
+	VirtualMachine& _vm;
+
 	Bios _bios;
 	bool _biosMode;
 
 	RAM _internalRAM;
+	RAM _highRAM;
+
+	/* read only, so machines cloned from each other share it */
+	std::shared_ptr<const std::vector<Byte>> _rom;
 
 public:
-	MMU(const Bios::Type bios);
+	MMU(VirtualMachine& vm, const Bios::Type bios);
 	~MMU();
 
+	void reset();
+
+	/* The cartridge ROM, mapped flat over 0x0000-0x7FFF; kept across resets and not
+	 * part of save states. Only ROM-only images: there are no bank controllers yet. */
+	bool loadRom(const char* filename);
+	void loadRom(const Byte* data, const size_t size);
+
+	inline const Byte* rom() const { return _rom ? _rom->data() : nullptr; }
+	inline size_t romSize() const { return _rom ? _rom->size() : 0; }
+
+	/* Shares the memory (and the ROM) of the source copy-on-write */
+	void copyState(const MMU& source);
+
+	/* Work RAM and high RAM hold the same bytes */
+	bool equalMemory(const MMU& mmu) const;
+
+	inline const Bios& bios() const { return _bios; }
+
+	void saveState(StateWriter& state) const;
+	void loadState(StateReader& state);
+
 	Byte read(const Address addr) const;
 	void write(const Address addr, const Byte value);
 
 	Word readWord(const Address addr) const;
 	void writeWord(const Address addr, const Word value);
+
+private:
+	Byte readIO(const Address addr) const;
+	void writeIO(const Address addr, const Byte value);
+
+	void dma(const Byte source);
 };
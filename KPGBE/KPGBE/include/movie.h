@@ -0,0 +1,100 @@
+#pragma once
+
+#include "common.h"
+#include "bios.h"
+#include "save_state.h"
+
+#include <vector>
+
+#define MOVIE_MAGIC 0x4D47504BU /* "KPGM" */
+#define MOVIE_VERSION 1
+
+#define MOVIE_FLAG_POWER_ON 0x1
+#define MOVIE_FLAG_FRAME_HASHES 0x2
+
+
+class VirtualMachine;
+
+struct MovieHeader
+{
+	u32 magic;
+	u16 version;
+	u8 machine;
+	u8 flags;
+	u64 romHash;
+	u64 frames;
+	u32 stateSize;
+	u32 inputs;
+};
+
+struct MovieInput
+{
+	Ticks when;
+	Byte buttons;
+	u8 reserved[7];
+};
+
+struct MovieReplay
+{
+	u64 frames;
+	u64 desyncFrame; /* first frame whose state hash differs, INVALID_TICKS if none */
+	bool stopped;
+
+	inline bool synced() const { return desyncFrame == INVALID_TICKS; }
+};
+
+
+/* A recording: the machine, a hash of the ROM, where it starts (power-on or a save
+ * state), every button change stamped with the tick it reached the joypad at and,
+ * optionally, a hash of the machine state at the end of every frame. Replaying
+ * queues the whole input stream up front and runs the machine frame after frame,
+ * so it goes as fast as the host allows and needs no frontend. */
+class Movie
+{
+private:
+	u8 _machine;
+	u8 _flags;
+	u64 _romHash;
+	SaveState _start;
+	std::vector<MovieInput> _inputs;
+	std::vector<u64> _frameHashes;
+	u64 _frames;
+
+	mutable SaveState _scratch;
+
+public:
+	Movie();
+	Movie(const Movie&) = default;
+
+	Movie& operator= (const Movie&) = default;
+
+	bool read(const char* filename);
+	bool write(const char* filename) const;
+
+	void clear();
+
+	/* Starts a recording from the machine as it is, or resets it first */
+	void record(VirtualMachine& vm, const u64 romHash, const bool powerOn, const bool frameHashes = true);
+
+	/* Queues the buttons on the machine and records them; without a tick they apply now */
+	void input(VirtualMachine& vm, const JoypadButtons& buttons);
+	void input(VirtualMachine& vm, const Ticks when, const JoypadButtons& buttons);
+
+	/* Call after every runFrame() of the recording that completes a frame */
+	void frame(const VirtualMachine& vm);
+
+	/* Puts the machine at the start of the movie with every input queued */
+	bool start(VirtualMachine& vm, const u64 romHash) const;
+
+	/* start(), then runs every frame, stopping at the first desync if verify is set */
+	bool replay(VirtualMachine& vm, const u64 romHash, MovieReplay& result, const bool verify = true) const;
+
+	inline Bios::Type machine() const { return static_cast<Bios::Type>(_machine); }
+	inline u64 romHash() const { return _romHash; }
+	inline bool isPowerOn() const { return (_flags & MOVIE_FLAG_POWER_ON) != 0; }
+	inline bool hasFrameHashes() const { return (_flags & MOVIE_FLAG_FRAME_HASHES) != 0; }
+	inline u64 frames() const { return _frames; }
+	inline size_t inputs() const { return _inputs.size(); }
+
+	u64 stateHash(const VirtualMachine& vm) const;
+};
@@ -40,7 +40,8 @@ public:
 	static const Opcode& of(Byte code);
 	static Ticks ticksOf(Byte code);
 
-	static void executeNext(VirtualMachine& vm);
+	/* repeatFetch leaves PC on the opcode byte (HALT bug) */
+	static void executeNext(VirtualMachine& vm, const bool repeatFetch = false);
 
 private:
 	static const Opcode OPCODES[256];
@@ -0,0 +1,167 @@
+#pragma once
+
+#include "common.h"
+#include "bios.h"
+#include "color.h"
+#include "sprites.h"
+#include "scaler.h"
+#include "video.h"
+#include "ram.h"
+
+#include <vector>
+
+#define VRAM_BANK_SIZE 8_KB
+#define DMG_PALETTES 3
+#define TILE_MAP_ROWS 64
+#define FRAME_TICKS 70224
+
+
+class VirtualMachine;
+class StateWriter;
+class StateReader;
+class RenderThread;
+
+class PPU
+{
+	friend class RenderThread;
+
+public:
+	enum class Mode : Byte { HBlank = 0, VBlank = 1, OAMScan = 2, Transfer = 3 };
+
+private:
+	/* Everything a rendered line depends on; equal signatures render equal pixels */
+	struct LineSignature
+	{
+		Byte lcdc;
+		Byte scx;
+		Byte scy;
+		Byte wx;
+		Byte windowLine;
+		u32 bgMapRow;
+		u32 windowMapRow;
+		u32 tiles;
+		u32 sprites;
+		u32 bgPalettes;
+		u32 objPalettes;
+
+		inline bool operator== (const LineSignature& s) const
+		{
+			return lcdc == s.lcdc && scx == s.scx && scy == s.scy && wx == s.wx && windowLine == s.windowLine &&
+				bgMapRow == s.bgMapRow && windowMapRow == s.windowMapRow && tiles == s.tiles &&
+				sprites == s.sprites && bgPalettes == s.bgPalettes && objPalettes == s.objPalettes;
+		}
+	};
+
+private:
+	bool _gbc;
+	ColorCorrection _correction;
+
+	Byte _lcdc;
+	Byte _stat;
+	Byte _scy;
+	Byte _scx;
+	Byte _ly;
+	Byte _lyc;
+	Byte _bgp;
+	Byte _obp0;
+	Byte _obp1;
+	Byte _wy;
+	Byte _wx;
+	Byte _vbk;
+
+	RAM _vram;
+	Byte _oam[OAM_SIZE];
+
+	ColorPalettes _bgPalettes;
+	ColorPalettes _objPalettes;
+	RGBA _dmgPalettes[DMG_PALETTES][PALETTE_COLORS];
+
+	SpriteIndex _sprites;
+
+	u32 _tileGeneration;
+	u32 _mapGenerations[TILE_MAP_ROWS];
+	LineSignature _signatures[SCREEN_HEIGHT];
+	LineMask _validLines;
+	LineMask _changedLines;
+
+	Ticks _lastTicks;
+	unsigned int _dot;
+	unsigned int _windowLine;
+	u64 _frames;
+
+	std::vector<RGBA> _frameBuffer;
+
+	VideoSink* _sink;
+	Scaler _scaler;
+
+	RenderThread* _renderThread;
+
+public:
+	/* A headless PPU keeps no frame buffer and renders nothing */
+	PPU(const Bios::Type type, const bool headless = false);
+	~PPU();
+
+	void reset();
+
+	/* Everything saveState would keep; VRAM is shared copy-on-write */
+	void copyState(const PPU& source);
+
+	void saveState(StateWriter& state) const;
+	void loadState(StateReader& state);
+
+	void step(VirtualMachine& vm);
+
+	/* Keeps a scheduler event at the next mode change while the LCD is on */
+	void schedule(VirtualMachine& vm) const;
+	void modeEvent(VirtualMachine& vm);
+
+	void setColorCorrection(const ColorCorrection correction);
+	ColorCorrection colorCorrection() const;
+
+	void setVideoSink(VideoSink* sink);
+	inline VideoSink* videoSink() const { return _sink; }
+
+	void setScaler(const Scaler& scaler);
+
+	/* Moves rendering to the given thread (nullptr renders inline again) */
+	void setRenderThread(RenderThread* thread);
+	inline RenderThread* renderThread() const { return _renderThread; }
+
+	inline const Scaler& scaler() const { return _scaler; }
+
+	Byte readRegister(const Address addr) const;
+	void writeRegister(const Address addr, const Byte value);
+
+	Byte readVRAM(const Address addr) const;
+	void writeVRAM(const Address addr, const Byte value);
+
+	Byte readOAM(const Address addr) const;
+	void writeOAM(const Address addr, const Byte value);
+
+	void dma(const Byte* data);
+
+	inline Mode mode() const { return static_cast<Mode>(_stat & 0x3); }
+	inline u64 frameCount() const { return _frames; }
+	inline const RGBA* frameBuffer() const { return _frameBuffer.empty() ? nullptr : _frameBuffer.data(); }
+	inline bool isHeadless() const { return _frameBuffer.empty(); }
+	inline const LineMask& changedLines() const { return _changedLines; }
+
+private:
+	unsigned int modeEndDot() const;
+	void setMode(VirtualMachine& vm, const Mode mode);
+	void nextLine(VirtualMachine& vm);
+	void compareLine(VirtualMachine& vm);
+
+	void present();
+
+	void resolveDMGPalette(const unsigned int index, const Byte value);
+
+	void invalidateLines();
+	void copyRenderState(const PPU& source);
+	void record(const u8 kind, const Address addr, const Byte value);
+
+	void renderLine();
+	void renderTiles(const unsigned int from, const unsigned int to, const Address mapBase,
+		unsigned int mapX, const unsigned int mapY, Byte* colorIds, Byte* priorities);
+	void renderSprites(const Byte* colorIds, const Byte* priorities);
+};
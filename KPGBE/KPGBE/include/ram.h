@@ -2,26 +2,90 @@
 
 #include "common.h"
 
+#include <atomic>
 
+#define RAM_PAGE_SHIFT 8
+#define RAM_PAGE_SIZE (0x1U << RAM_PAGE_SHIFT)
+#define RAM_PAGE_MASK (RAM_PAGE_SIZE - 1)
+
+
+class StateWriter;
+class StateReader;
+
+/* Memory split in pages shared copy-on-write: copying a RAM only copies its page
+ * table, and a page is duplicated the first time one of the copies writes to it.
+ * Pages nobody wrote to yet all share a single page of zeros.
+ * Copies may live on different threads; copying a RAM itself must not race with
+ * writes to it. */
 class RAM
 {
 private:
-	Byte* _mem;
+	struct Page
+	{
+		std::atomic<u32> refs;
+		Byte data[RAM_PAGE_SIZE];
+	};
+
+private:
+	Page** _pages;
+	mutable Byte** _writable; /* data of the pages only this RAM refers to, otherwise nullptr */
 	size_t _size;
+	size_t _count;
 
 public:
 	RAM(const size_t size);
+	RAM(const RAM& ram);
 	~RAM();
 
+	RAM& operator= (const RAM& ram);
+
 	size_t size() const;
 
 	void dump(std::ostream& os, const size_t bytesPerRow = 0x10);
 
-	void write(const Address addr, const Byte value);
-	Byte read(const Address addr) const;
+	inline void write(const Address addr, const Byte value)
+	{
+		const size_t offset = addr % _size;
+		Byte* data = _writable[offset >> RAM_PAGE_SHIFT];
+		if (!data)
+			data = own(offset >> RAM_PAGE_SHIFT);
+		data[offset & RAM_PAGE_MASK] = value;
+	}
+
+	inline Byte read(const Address addr) const
+	{
+		const size_t offset = addr % _size;
+		return _pages[offset >> RAM_PAGE_SHIFT]->data[offset & RAM_PAGE_MASK];
+	}
+
+	inline Byte operator[] (const Address& addr) const { return read(addr); }
 
-	Byte& operator[] (const Address& addr);
-	const Byte& operator[] (const Address& addr) const;
+	/* Points at addr; stays valid up to the end of its page and until the next write */
+	inline const Byte* at(const size_t offset) const { return _pages[offset >> RAM_PAGE_SHIFT]->data + (offset & RAM_PAGE_MASK); }
+
+	inline size_t pages() const { return _count; }
+	inline const Byte* page(const size_t index) const { return _pages[index]->data; }
+	inline size_t pageSize(const size_t index) const { return min<size_t>(RAM_PAGE_SIZE, _size - index * RAM_PAGE_SIZE); }
+
+	/* Overwrites the whole memory, or zeros it */
+	void assign(const Byte* data);
+	void clear();
+
+	/* The memory as one raw section of the given id */
+	void saveState(StateWriter& state, const u32 id) const;
+	void loadState(StateReader& state, const u32 id);
+
+	/* Pages this RAM shares with a copy */
+	size_t sharedPages() const;
+
+	/* Same contents; pages shared with the other RAM are not even read */
+	bool equals(const RAM& ram) const;
 
 	friend std::ostream& operator<< (std::ostream& os, const RAM& ram);
+
+private:
+	Byte* own(const size_t index, const bool keep = true);
+	void release();
+
+	static Page* zeroPage();
 };
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "common.h"
+
+#define RATE_CONTROL_MAX_DEVIATION 0.005
+#define RATE_CONTROL_SMOOTHING 0.05
+#define RATE_CONTROL_INTEGRAL 0.002
+
+
+/* Dynamic rate control. Emulation runs against the display clock, so the audio
+ * it produces drifts slightly from what the device consumes. Instead of blocking
+ * on either, the output sample rate is nudged (by at most maxDeviation) so the
+ * sink buffer converges to, and stays at, a target fill level. The integral term
+ * absorbs a constant clock drift so the fill level does not settle off target. */
+class RateControl
+{
+private:
+	f64 _maxDeviation;
+	size_t _targetFrames;
+
+	f64 _fill;
+	f64 _drift;
+	f64 _ratio;
+	u64 _updates;
+
+public:
+	RateControl();
+	RateControl(const RateControl&) = default;
+
+	RateControl& operator= (const RateControl&) = default;
+
+	void reset();
+
+	void setMaxDeviation(const f64 deviation);
+	inline f64 maxDeviation() const { return _maxDeviation; }
+
+	/* 0 targets half of the sink capacity */
+	inline void setTargetFrames(const size_t frames) { _targetFrames = frames; }
+	inline size_t targetFrames() const { return _targetFrames; }
+
+	/* Feeds the current sink fill level; returns the new output rate ratio */
+	f64 update(const size_t bufferedFrames, const size_t capacityFrames);
+
+	/* Telemetry */
+	inline f64 ratio() const { return _ratio; }
+	inline f64 smoothedFill() const { return _fill; }
+	inline f64 estimatedDrift() const { return _drift * _maxDeviation; }
+	inline u64 updates() const { return _updates; }
+};
@@ -6,6 +6,9 @@
 #define DISABLED_FLAG 0
 
 
+class StateWriter;
+class StateReader;
+
 typedef u8 Reg8;
 typedef u16 Reg16;
 
@@ -72,6 +75,9 @@ public:
 
 	void reset();
 
+	void saveState(StateWriter& state) const;
+	void loadState(StateReader& state);
+
 	inline void setCarryFlag() { carryFlag = ENABLED_FLAG; }
 	inline void setHalfCarryFlag() { halfCarryFlag = ENABLED_FLAG; }
 	inline void setSubtractFlag() { subtractFlag = ENABLED_FLAG; }
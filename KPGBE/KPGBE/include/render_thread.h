@@ -0,0 +1,76 @@
+#pragma once
+
+#include "common.h"
+#include "ppu.h"
+#include "spsc.h"
+
+#include <thread>
+
+#define RENDER_LOG_CAPACITY 0x10000
+
+/* empty polls before the render thread starts sleeping between polls */
+#define RENDER_IDLE_SPINS 64
+#define RENDER_IDLE_SLEEP_MICROS 200
+
+
+/* One PPU visible event; line is the line to render for RenderLine */
+struct RenderLogEntry
+{
+	enum class Kind : u8 { Register, VRAM, OAM, DMA, DMAEnd, ColorCorrection, RenderLine, FrameEnd };
+
+	Kind kind;
+	Byte value;
+	Address address;
+	Byte line;
+};
+
+
+/* Renders frames on a second core. The emulation side PPU stops rendering and only
+ * logs its VRAM/OAM/palette/LCD register writes together with the points where a
+ * line would have been rendered; this thread replays the log in order on a shadow
+ * PPU. Lines are rendered whole at the same point as inline rendering does, so the
+ * frames come out exactly the same: raster effects are line exact, not dot exact.
+ * When the log stays empty the thread backs off to short sleeps. */
+class RenderThread
+{
+private:
+	PPU _ppu;
+	SPSCRing<RenderLogEntry> _log;
+
+	std::thread _thread;
+	std::atomic<bool> _running;
+	std::atomic<u64> _frames;
+
+	u64 _recorded;
+	std::atomic<u64> _replayed;
+
+public:
+	RenderThread(const Bios::Type type, const size_t capacity = RENDER_LOG_CAPACITY);
+	RenderThread(const RenderThread&) = delete;
+	~RenderThread();
+
+	RenderThread& operator= (const RenderThread&) = delete;
+
+	/* The shadow PPU (sink, scaler) may only be configured while the thread is stopped */
+	inline PPU& ppu() { return _ppu; }
+
+	void start(const PPU& source);
+	void stop();
+	bool isRunning() const;
+
+	/* Blocks until every logged event has been replayed */
+	void flush() const;
+
+	inline u64 framesRendered() const { return _frames.load(std::memory_order_acquire); }
+
+	inline void record(const RenderLogEntry& entry)
+	{
+		while (!_log.push(entry))
+			std::this_thread::yield();
+		_recorded++;
+	}
+
+private:
+	void run();
+	void replay(const RenderLogEntry& entry);
+};
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "common.h"
+#include "audio.h"
+
+#include <vector>
+
+#define RESAMPLER_MAX_PHASES 512
+#define RESAMPLER_BLOCK 0x400
+
+
+/* Taps per phase: more taps mean a sharper anti-aliasing filter and more latency */
+enum class ResamplerQuality { Fast, Balanced, Best };
+
+
+/* Polyphase FIR sample rate converter. The rate ratio is reduced to L/M; every
+ * output sample is one dot product between the input history and one of the L
+ * precomputed filter phases (SSE/AVX when available). When L is larger than
+ * RESAMPLER_MAX_PHASES the rate stays exact and each output uses the nearest
+ * of RESAMPLER_MAX_PHASES phases. */
+class Resampler
+{
+private:
+	unsigned int _inputRate;
+	unsigned int _outputRate;
+	unsigned int _channels;
+	ResamplerQuality _quality;
+
+	unsigned int _taps;
+	unsigned int _phases;
+	unsigned int _denominator;
+	unsigned int _step;
+	std::vector<f32> _coefs;
+
+	std::vector<f32> _history[2];
+	size_t _historySize;
+	size_t _position;
+	unsigned int _phase;
+
+public:
+	Resampler();
+	Resampler(const Resampler&) = default;
+
+	Resampler& operator= (const Resampler&) = default;
+
+	/* Input is always interleaved stereo; output has 1 (downmixed) or 2 channels */
+	bool configure(const unsigned int inputRate, const unsigned int outputRate, const unsigned int channels, const ResamplerQuality quality);
+	void reset();
+
+	inline unsigned int inputRate() const { return _inputRate; }
+	inline unsigned int outputRate() const { return _outputRate; }
+	inline unsigned int channels() const { return _channels; }
+	inline ResamplerQuality quality() const { return _quality; }
+	inline unsigned int latency() const { return _taps / 2; }
+
+	/* Upper bound of the frames process produces for the given input */
+	inline size_t maxOutputFrames(const size_t inputFrames) const { return ((inputFrames + _taps) * _denominator) / _step + 1; }
+
+	/* Consumes all input frames; out must hold maxOutputFrames(frames) frames. Returns the frames written */
+	size_t process(const s16* in, const size_t frames, s16* out);
+
+private:
+	void buildFilter();
+	size_t processBlock(const s16* in, const size_t frames, s16* out);
+};
+
+
+/* Sink adapter: the APU synthesizes at inputRate in stereo and the target sink
+ * gets the converted stream at its own rate and channel count. If the rates or the
+ * channel count of the target are unusable the error is reported and the samples
+ * are dropped. */
+class ResamplingSink : public AudioSink
+{
+private:
+	AudioSink& _target;
+	Resampler _resampler;
+	unsigned int _inputRate;
+	bool _valid;
+
+	s16 _staging[RESAMPLER_BLOCK * 2];
+	std::vector<s16> _output;
+
+public:
+	ResamplingSink(AudioSink& target, const unsigned int inputRate, const ResamplerQuality quality = ResamplerQuality::Balanced);
+
+	inline const Resampler& resampler() const { return _resampler; }
+	inline bool isValid() const { return _valid; }
+
+	unsigned int sampleRate() const override;
+
+	s16* lockSamples(size_t& frames) override;
+	void unlockSamples(const size_t frames) override;
+
+	/* Reported in input frames so rate control keeps working through the adapter */
+	size_t bufferedFrames() const override;
+	size_t capacityFrames() const override;
+};
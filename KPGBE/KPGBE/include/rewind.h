@@ -0,0 +1,68 @@
+#pragma once
+
+#include "common.h"
+#include "save_state.h"
+
+#include <vector>
+
+#define REWIND_DEFAULT_CAPACITY (32 * MEGABYTE)
+#define REWIND_DEFAULT_INTERVAL 2
+
+
+class VirtualMachine;
+
+/* Rewind history in a fixed size byte ring. The newest snapshot is kept whole; every
+ * older one is stored as the XOR of it and the snapshot after it, run-length coded
+ * (consecutive states differ in a few hundred bytes, the rest of the delta is zeros).
+ * Stepping back XORs the newest delta into the whole snapshot, so history is always
+ * rebuilt from the newest end and the oldest deltas can simply be dropped when the
+ * ring is full. */
+class Rewind
+{
+private:
+	std::vector<Byte> _ring;
+	size_t _head;
+	size_t _tail;
+	size_t _used;
+	size_t _count;
+
+	unsigned int _interval;
+	unsigned int _frames;
+
+	SaveState _capture;
+	std::vector<Byte> _latest;
+	std::vector<Byte> _delta;
+
+public:
+	Rewind(const size_t capacity = REWIND_DEFAULT_CAPACITY, const unsigned int interval = REWIND_DEFAULT_INTERVAL);
+	Rewind(const Rewind&) = delete;
+
+	Rewind& operator= (const Rewind&) = delete;
+
+	/* Call once per emulated frame; takes a snapshot every interval frames */
+	void capture(const VirtualMachine& vm);
+
+	/* Loads the newest snapshot and drops it from the history; false once it is empty */
+	bool rewind(VirtualMachine& vm);
+
+	void clear();
+
+	void setInterval(const unsigned int interval);
+	inline unsigned int interval() const { return _interval; }
+
+	/* Snapshots that rewind() can still go back to */
+	inline size_t snapshots() const { return _count + (_latest.empty() ? 0 : 1); }
+	inline size_t usedBytes() const { return _used; }
+	inline size_t capacity() const { return _ring.size(); }
+
+private:
+	void push(const Byte* data, const size_t size);
+	bool pop();
+	void dropOldest();
+
+	void copyIn(size_t position, const Byte* data, const size_t size);
+	void copyOut(size_t position, Byte* data, const size_t size) const;
+
+	void encode(const Byte* current);
+	void decode(const Byte* data, const size_t size);
+};
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "common.h"
+#include "save_state.h"
+#include "apu.h"
+#include "joypad.h"
+
+#include <memory>
+
+
+class VirtualMachine;
+class VideoSink;
+enum class RunStatus : u8;
+
+/* Cost of the state round trip of every presented frame, in microseconds */
+struct RunAheadStats
+{
+	u64 frames;
+	f64 saveMicros;
+	f64 loadMicros;
+	f64 maxSaveMicros;
+	f64 maxLoadMicros;
+	f64 totalSaveMicros;
+	f64 totalLoadMicros;
+
+	inline f64 averageSaveMicros() const { return frames ? totalSaveMicros / frames : 0; }
+	inline f64 averageLoadMicros() const { return frames ? totalLoadMicros / frames : 0; }
+};
+
+
+/* Hides the input lag of the game itself: every presented frame runs the machine one
+ * frame, then a few frames further with the same input, shows the last of those and
+ * goes back. The sinks attached to the machine are used; hidden frames get none.
+ * With a single instance the machine itself runs ahead and its state is restored
+ * afterwards, along with the samples not delivered yet. With a second instance the
+ * state is loaded into a private copy that runs ahead and owns the video, so the
+ * machine itself never rewinds and its audio is never touched.
+ * Not for machines plugged into a link cable or rendering on a render thread. */
+class RunAhead
+{
+private:
+	unsigned int _frames;
+	bool _secondInstance;
+
+	SaveState _state;
+	APU _apu;
+	Joypad _joypad;
+	std::unique_ptr<VirtualMachine> _ahead;
+
+	RunAheadStats _stats;
+
+public:
+	RunAhead(const unsigned int frames = 1, const bool secondInstance = false);
+	RunAhead(const RunAhead&) = delete;
+	~RunAhead();
+
+	RunAhead& operator= (const RunAhead&) = delete;
+
+	/* Call instead of vm.runFrame() once per presented frame */
+	RunStatus runFrame(VirtualMachine& vm);
+
+	void setFrames(const unsigned int frames);
+	inline unsigned int frames() const { return _frames; }
+
+	void setSecondInstance(const bool enabled);
+	inline bool isSecondInstance() const { return _secondInstance; }
+
+	inline const RunAheadStats& stats() const { return _stats; }
+	void resetStats();
+
+private:
+	RunStatus runSingle(VirtualMachine& vm, VideoSink* video);
+	RunStatus runSecond(VirtualMachine& vm, VideoSink* video);
+
+	void measure(const f64 save, const f64 load);
+};
@@ -0,0 +1,156 @@
+#pragma once
+
+#include "common.h"
+
+#include <cstring>
+#include <vector>
+
+#define SAVE_STATE_MAGIC 0x5347504BU /* "KPGS" */
+#define SAVE_STATE_VERSION 2
+#define SAVE_STATE_ALIGNMENT 64
+#define SAVE_STATE_MAX_SECTIONS 32
+
+#define STATE_SECTION(_A, _B, _C, _D) \
+	(static_cast<u32>(_A) | (static_cast<u32>(_B) << 8) | (static_cast<u32>(_C) << 16) | (static_cast<u32>(_D) << 24))
+
+
+struct SaveStateHeader
+{
+	u32 magic;
+	u16 version;
+	u8 machine;
+	u8 sections;
+	u32 size;
+	u32 reserved;
+};
+
+struct SaveStateSection
+{
+	u32 id;
+	u32 offset;
+	u32 size;
+	u32 reserved;
+};
+
+
+/* A snapshot of a machine: header, section table, then the sections, each aligned
+ * to 64 bytes. Memory regions (work RAM, VRAM, OAM...) are stored raw as their own
+ * sections, so loading them is a single memcpy straight from the buffer, which may
+ * just as well be a memory mapped file. Little endian, fields in native layout. */
+class SaveState
+{
+	friend class StateWriter;
+
+private:
+	std::vector<Byte> _data;
+
+public:
+	SaveState();
+	SaveState(const SaveState&) = default;
+	SaveState(SaveState&&) = default;
+
+	SaveState& operator= (const SaveState&) = default;
+	SaveState& operator= (SaveState&&) = default;
+
+	inline const Byte* data() const { return _data.data(); }
+	inline size_t size() const { return _data.size(); }
+	inline bool empty() const { return _data.empty(); }
+
+	inline u64 hash() const { return HashBytes(_data.data(), _data.size()); }
+
+	bool read(const char* filename);
+	bool write(const char* filename) const;
+
+	void assign(const Byte* data, const size_t size);
+	void clear();
+};
+
+
+class StateWriter
+{
+private:
+	std::vector<Byte>& _data;
+	size_t _section;
+
+public:
+	StateWriter(SaveState& state, const u8 machine);
+	StateWriter(const StateWriter&) = delete;
+
+	StateWriter& operator= (const StateWriter&) = delete;
+
+	/* Sections are written one at a time; the header is kept up to date on every end() */
+	void begin(const u32 id);
+	void end();
+
+	inline void write(const void* data, const size_t size)
+	{
+		const Byte* bytes = static_cast<const Byte*>(data);
+		_data.insert(_data.end(), bytes, bytes + size);
+	}
+
+	template<typename _Ty>
+	inline void write(const _Ty& value) { write(&value, sizeof(_Ty)); }
+
+	inline void region(const u32 id, const void* data, const size_t size)
+	{
+		begin(id);
+		write(data, size);
+		end();
+	}
+
+private:
+	SaveStateSection& section(const unsigned int index);
+};
+
+
+/* Reads never go past the current section; a short or missing section marks the
+ * reader as failed and reads zeros, so the caller only has to check ok() once. */
+class StateReader
+{
+private:
+	const Byte* _data;
+	size_t _size;
+	unsigned int _sections;
+	unsigned int _next;
+
+	const Byte* _cursor;
+	const Byte* _end;
+	bool _ok;
+
+public:
+	StateReader(const Byte* data, const size_t size);
+	StateReader(const StateReader&) = delete;
+
+	StateReader& operator= (const StateReader&) = delete;
+
+	/* Checks the header and the section table */
+	bool open(const u8 machine);
+
+	bool begin(const u32 id);
+
+	inline void read(void* out, const size_t size)
+	{
+		if (static_cast<size_t>(_end - _cursor) < size)
+		{
+			std::memset(out, 0, size);
+			_ok = false;
+			return;
+		}
+		std::memcpy(out, _cursor, size);
+		_cursor += size;
+	}
+
+	template<typename _Ty>
+	inline void read(_Ty& value) { read(&value, sizeof(_Ty)); }
+
+	/* The raw bytes of a section of exactly that size, or nullptr */
+	const Byte* region(const u32 id, const size_t size);
+
+	inline bool ok() const { return _ok; }
+
+	/* For values read fine but out of range: the state is rejected as if it were short */
+	inline void fail() { _ok = false; }
+
+private:
+	const SaveStateSection& section(const unsigned int index) const;
+};
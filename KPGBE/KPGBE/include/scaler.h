@@ -0,0 +1,39 @@
+#pragma once
+
+#include "common.h"
+
+#define MAX_SCALE_FACTOR 8
+
+
+enum class ScaleFilter { Nearest, Scale2x, Scale3x, EdgeBlend2x };
+
+
+/* Post-processing stage between the PPU frame buffer and the video sink */
+class Scaler
+{
+private:
+	ScaleFilter _filter;
+	unsigned int _factor;
+
+public:
+	Scaler();
+	Scaler(const Scaler&) = default;
+
+	Scaler& operator= (const Scaler&) = default;
+
+	/* Only Nearest accepts arbitrary factors; the other filters have a fixed one */
+	bool setFilter(const ScaleFilter filter, const unsigned int factor = 1);
+
+	inline ScaleFilter filter() const { return _filter; }
+	inline unsigned int factor() const { return _factor; }
+
+	inline unsigned int outputWidth(const unsigned int width) const { return width * _factor; }
+	inline unsigned int outputHeight(const unsigned int height) const { return height * _factor; }
+
+	/* dst must hold outputHeight(height) rows of dstPitch pixels */
+	void apply(const RGBA* src, const unsigned int width, const unsigned int height, RGBA* dst, const size_t dstPitch) const;
+
+	/* Only rows [first, last) of the source are processed */
+	void applyLines(const RGBA* src, const unsigned int width, const unsigned int height,
+		const unsigned int first, const unsigned int last, RGBA* dst, const size_t dstPitch) const;
+};
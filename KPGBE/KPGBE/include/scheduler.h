@@ -0,0 +1,58 @@
+#pragma once
+
+#include "common.h"
+
+
+class VirtualMachine;
+class StateWriter;
+class StateReader;
+
+enum class SchedulerEvent : u8
+{
+	FrameSequencer,
+	TimerOverflow,
+	PPUMode,
+	SerialTransfer,
+	JoypadInput,
+
+	Count
+};
+
+#define SCHEDULER_EVENTS static_cast<unsigned int>(SchedulerEvent::Count)
+
+
+/* Pending timed events, one slot per event type. Components schedule the tick
+ * at which they next need attention instead of being stepped every instruction;
+ * the run loop only has to compare the current tick against nextEvent(). */
+class Scheduler
+{
+private:
+	Ticks _deadlines[SCHEDULER_EVENTS];
+	Ticks _next;
+	unsigned int _nextEvent;
+
+public:
+	Scheduler();
+	Scheduler(const Scheduler&) = default;
+
+	Scheduler& operator= (const Scheduler&) = default;
+
+	void reset();
+
+	void saveState(StateWriter& state) const;
+	void loadState(StateReader& state);
+
+	void schedule(const SchedulerEvent event, const Ticks when);
+	void cancel(const SchedulerEvent event);
+
+	inline Ticks deadline(const SchedulerEvent event) const { return _deadlines[static_cast<unsigned int>(event)]; }
+	inline Ticks nextEvent() const { return _next; }
+	inline bool pending(const Ticks now) const { return _next <= now; }
+
+	/* Fires, in deadline order, every event due at or before now */
+	void dispatch(VirtualMachine& vm, const Ticks now);
+
+private:
+	void updateNext();
+	void fire(VirtualMachine& vm, const SchedulerEvent event, const Ticks when);
+};
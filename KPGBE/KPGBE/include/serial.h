@@ -0,0 +1,56 @@
+#pragma once
+
+#include "common.h"
+#include "bios.h"
+
+
+class VirtualMachine;
+class StateWriter;
+class StateReader;
+class LinkCable;
+
+/* SB/SC serial port. With the internal clock a transfer lasts 8 bit times of the
+ * CPU clock and its end is a scheduler event; with the external clock the port
+ * waits for the other side of the link cable. While connected the port also
+ * keeps a periodic event to let the cable know how far this machine has run. */
+class Serial
+{
+	friend class LinkCable;
+
+private:
+	bool _gbc;
+
+	Byte _sb;
+	Byte _sc;
+	Ticks _transferEnd;
+
+	LinkCable* _cable;
+	unsigned int _side;
+
+public:
+	Serial(const Bios::Type type);
+	Serial(const Serial&) = default;
+
+	Serial& operator= (const Serial&) = default;
+
+	void reset();
+
+	void saveState(StateWriter& state) const;
+	void loadState(StateReader& state, const Ticks now);
+
+	/* The port of the source, without plugging this one into its cable */
+	void copyState(const Serial& source);
+
+	Byte readRegister(const Address addr) const;
+	void writeRegister(VirtualMachine& vm, const Address addr, const Byte value);
+
+	void schedule(VirtualMachine& vm);
+	void transferEvent(VirtualMachine& vm, const Ticks when);
+
+	inline LinkCable* cable() const { return _cable; }
+	inline bool isTransferring() const { return (_sc & 0x80) != 0; }
+
+private:
+	inline bool internalClock() const { return (_sc & 0x1) != 0; }
+	void complete(VirtualMachine& vm, const Byte received);
+};
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "common.h"
+
+#define OAM_SIZE 0xA0
+#define OAM_SPRITES 40
+#define SPRITES_PER_LINE 10
+#define SPRITE_LINES 144
+
+
+/* Per scanline sprite selection, kept up to date on every OAM write instead of
+ * scanning the 40 OAM entries each line. Each line stores the set of sprites
+ * that cover it; the ready list (first 10 in OAM order, sorted by drawing
+ * priority) is only rebuilt for lines whose set changed. A generation counter
+ * per line changes whenever anything drawn by its sprites may have changed. */
+class SpriteIndex
+{
+private:
+	bool _xPriority;
+	unsigned int _height;
+
+	Byte _y[OAM_SPRITES];
+	Byte _x[OAM_SPRITES];
+
+	u64 _coverage[SPRITE_LINES];
+	Byte _selected[SPRITE_LINES][SPRITES_PER_LINE];
+	u8 _count[SPRITE_LINES];
+	bool _dirty[SPRITE_LINES];
+	u32 _generations[SPRITE_LINES];
+
+public:
+	SpriteIndex(const bool xPriority);
+	SpriteIndex(const SpriteIndex&) = default;
+
+	SpriteIndex& operator= (const SpriteIndex&) = default;
+
+	void rebuild(const Byte* oam, const unsigned int height);
+	void update(const Address offset, const Byte value);
+	void setHeight(const unsigned int height);
+
+	inline unsigned int height() const { return _height; }
+	inline u32 generation(const unsigned int ly) const { return _generations[ly]; }
+
+	/* Sprites of the line, highest drawing priority first */
+	inline const Byte* line(const unsigned int ly, unsigned int& count)
+	{
+		if (_dirty[ly])
+			select(ly);
+		count = _count[ly];
+		return _selected[ly];
+	}
+
+private:
+	void insert(const unsigned int sprite);
+	void remove(const unsigned int sprite);
+	void invalidate(const unsigned int sprite);
+	void touch(const unsigned int sprite);
+	void select(const unsigned int ly);
+};
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "common.h"
+
+#include <atomic>
+
+
+/* Lock-free single producer / single consumer ring buffer.
+ * Capacity is rounded up to a power of two. */
+template<typename _Ty>
+class SPSCRing
+{
+private:
+	_Ty* _buffer;
+	size_t _mask;
+
+	alignas(64) std::atomic<size_t> _head;
+	alignas(64) std::atomic<size_t> _tail;
+
+public:
+	SPSCRing(const size_t capacity) :
+		_buffer{ nullptr },
+		_mask{ 0 },
+		_head{ 0 },
+		_tail{ 0 }
+	{
+		size_t size = 1;
+		while (size < capacity)
+			size <<= 1;
+		_buffer = new _Ty[size];
+		_mask = size - 1;
+	}
+	SPSCRing(const SPSCRing&) = delete;
+	~SPSCRing() { delete[] _buffer; }
+
+	SPSCRing& operator= (const SPSCRing&) = delete;
+
+	inline size_t capacity() const { return _mask + 1; }
+	inline size_t size() const { return _tail.load(std::memory_order_acquire) - _head.load(std::memory_order_acquire); }
+	inline bool empty() const { return size() == 0; }
+	inline size_t free() const { return capacity() - size(); }
+
+	/* Producer side */
+	inline bool push(const _Ty& value)
+	{
+		const size_t tail = _tail.load(std::memory_order_relaxed);
+		if (tail - _head.load(std::memory_order_acquire) > _mask)
+			return false;
+
+		_buffer[tail & _mask] = value;
+		_tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	/* Producer side, zero-copy: contiguous free space of up to count elements (count is updated) */
+	inline _Ty* writeRegion(size_t& count)
+	{
+		const size_t tail = _tail.load(std::memory_order_relaxed);
+		const size_t room = capacity() - (tail - _head.load(std::memory_order_acquire));
+		count = min(count, min(room, capacity() - (tail & _mask)));
+		return _buffer + (tail & _mask);
+	}
+	inline void commitWrite(const size_t count) { _tail.store(_tail.load(std::memory_order_relaxed) + count, std::memory_order_release); }
+
+	/* Consumer side */
+	inline bool pop(_Ty& value)
+	{
+		const size_t head = _head.load(std::memory_order_relaxed);
+		if (head == _tail.load(std::memory_order_acquire))
+			return false;
+
+		value = _buffer[head & _mask];
+		_head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	/* Consumer side, zero-copy: contiguous readable elements, up to count (count is updated) */
+	inline const _Ty* readRegion(size_t& count) const
+	{
+		const size_t head = _head.load(std::memory_order_relaxed);
+		const size_t available = _tail.load(std::memory_order_acquire) - head;
+		count = min(count, min(available, capacity() - (head & _mask)));
+		return _buffer + (head & _mask);
+	}
+	inline void commitRead(const size_t count) { _head.store(_head.load(std::memory_order_relaxed) + count, std::memory_order_release); }
+};
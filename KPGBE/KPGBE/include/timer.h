@@ -0,0 +1,54 @@
+#pragma once
+
+#include "common.h"
+
+#define DIV_REGISTER 0xFF04
+
+class VirtualMachine;
+class StateWriter;
+class StateReader;
+
+/* DIV/TIMA/TMA/TAC. Nothing is counted per instruction: DIV is derived from the
+ * current CPU cycle and the cycle of the last DIV reset, TIMA is brought up to date
+ * only when it is read or the timer is reprogrammed, and its overflow is a
+ * scheduler event. Falling edges caused by writing DIV or TAC are reproduced. */
+class Timer
+{
+private:
+	Ticks _divBase;
+	Ticks _cycles;
+	Ticks _reloadAt;
+
+	Byte _tima;
+	Byte _tma;
+	Byte _tac;
+
+public:
+	Timer();
+	Timer(const Timer&) = default;
+
+	Timer& operator= (const Timer&) = default;
+
+	void reset();
+
+	void saveState(StateWriter& state) const;
+	void loadState(StateReader& state);
+
+	Byte readRegister(VirtualMachine& vm, const Address addr);
+	void writeRegister(VirtualMachine& vm, const Address addr, const Byte value);
+
+	/* Scheduler callback: TIMA reload after an overflow. The timer runs on CPU cycles
+	 * (twice as fast in double speed mode), its events are converted to ticks. */
+	void overflowEvent(VirtualMachine& vm, const Ticks when);
+
+	inline u16 counter(const Ticks now) const { return static_cast<u16>(now - _divBase); }
+
+private:
+	void update(VirtualMachine& vm, const Ticks now);
+	void increment(const Ticks when);
+	void reload(VirtualMachine& vm);
+	void schedule(VirtualMachine& vm);
+
+	bool signal(const Ticks now) const;
+	inline bool enabled() const { return (_tac & 0x4) != 0; }
+};
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "common.h"
+
+#include <bitset>
+
+#define SCREEN_WIDTH 160
+#define SCREEN_HEIGHT 144
+
+
+typedef std::bitset<SCREEN_HEIGHT> LineMask;
+
+
+/* Frontend side of the video output. The PPU writes each finished frame
+ * straight into the buffer returned by lockFrame, then reports which
+ * screen lines changed since the previous frame. */
+class VideoSink
+{
+public:
+	virtual ~VideoSink() = default;
+
+	/* Returns a buffer of at least height rows of width pixels; pitch is the row stride in pixels */
+	virtual RGBA* lockFrame(const unsigned int width, const unsigned int height, size_t& pitch) = 0;
+	virtual void unlockFrame(const LineMask& changedLines) = 0;
+
+	/* Sinks whose buffer keeps the previous frame only get the changed lines rewritten */
+	virtual bool keepsFrame() const { return false; }
+};
@@ -4,6 +4,28 @@
 #include "mmu.h"
 #include "registers.h"
 #include "interrupts.h"
+#include "ppu.h"
+#include "apu.h"
+#include "timer.h"
+#include "serial.h"
+#include "joypad.h"
+#include "scheduler.h"
+#include "opcodes.h"
+#include "save_state.h"
+
+#include <bitset>
+#include <memory>
+
+#define BREAKPOINT_SPACE 0x10000
+
+
+enum class RunStatus : u8
+{
+	CyclesDone,
+	FrameComplete,
+	Breakpoint,
+	Stopped
+};
 
 
 class VirtualMachine
@@ -13,13 +35,55 @@ public:
 	CPU cpu;
 	Registers regs;
 	Interrupts ints;
+	PPU ppu;
+	APU apu;
+	Timer timer;
+	Serial serial;
+	Joypad joypad;
+	Scheduler scheduler;
 
 public:
-	VirtualMachine(const Bios::Type bios);
+	/* A headless machine renders no frames and synthesizes no audio; it runs the same */
+	VirtualMachine(const Bios::Type bios, const bool headless = false);
+	VirtualMachine(const VirtualMachine&) = delete;
 	~VirtualMachine();
 
+	VirtualMachine& operator= (const VirtualMachine&) = delete;
+
 	void reset();
 
+	/* A copy of the machine, as saveState would keep it. Memory is shared copy-on-write
+	 * with this machine and only the pages either of them writes to get duplicated, so a
+	 * headless clone costs the component state (a few KB) plus the page tables.
+	 * The machine must not be running while it is cloned. */
+	std::unique_ptr<VirtualMachine> clone(const bool headless = true) const;
+
+	/* The emulation entry point: runs whole instructions until at least cycles ticks have
+	 * elapsed, the CPU executes STOP or reaches a breakpoint. The instruction at the
+	 * starting PC never triggers a breakpoint, so a run can resume from one. */
+	RunStatus runCycles(const Ticks cycles);
+
+	/* As runCycles, until the PPU enters VBlank (or one frame time with the LCD off) */
+	RunStatus runFrame();
+
+	/* Everything but what the frontend attaches (sinks, render thread, link cable,
+	 * queued inputs, breakpoints). Saving into the same SaveState again reuses its memory. */
+	void saveState(SaveState& state) const;
+	bool loadState(const SaveState& state);
+
+	/* Loads straight from memory, e.g. a memory mapped file */
+	bool loadState(const Byte* data, const size_t size);
+
+	void setBreakpoint(const Address addr, const bool enabled = true);
+	void clearBreakpoints();
+	inline bool hasBreakpoint(const Address addr) const { return _breakpoints && (*_breakpoints)[addr]; }
+
+private:
+	void startScheduler();
+	u8 machine() const;
+
+	RunStatus run(const Ticks limit, const bool untilFrame);
+
 
 public:
 	class Stack
@@ -37,5 +101,44 @@ public:
 		Word popWord();
 	};
 	Stack stack;
+
+private:
+	std::unique_ptr<std::bitset<BREAKPOINT_SPACE>> _breakpoints;
+	unsigned int _breakpointCount;
 };
 
+
+inline void CPU::step(VirtualMachine& vm, const Ticks limit)
+{
+	if (_stop)
+		return;
+
+	if (_halted)
+	{
+		/* nothing runs until an interrupt is pending: jump straight to the next event */
+		if (!vm.ints.pending())
+		{
+			const Ticks target = min(vm.scheduler.nextEvent(), limit);
+			const Ticks cycle = _ticks + (4 >> _speedShift);
+			_ticks = target != INVALID_TICKS ? max(target, cycle) : cycle;
+			if (vm.scheduler.pending(_ticks))
+				vm.scheduler.dispatch(vm, _ticks);
+			return;
+		}
+		_halted = false;
+	}
+	else
+	{
+		const bool haltBug = _haltBug;
+		_haltBug = false;
+		Opcode::executeNext(vm, haltBug);
+		vm.ints.instructionDone();
+
+		if (vm.scheduler.pending(_ticks))
+			vm.scheduler.dispatch(vm, _ticks);
+	}
+
+	if (vm.ints.master && vm.ints.pending())
+		vm.ints.dispatch(vm);
+}
+
@@ -0,0 +1,604 @@
+#include "apu.h"
+
+#include "vm.h"
+#include "save_state.h"
+
+
+#define APU_GAIN 32
+
+#define NR10 0x00
+#define NR30 0x0A
+#define NR32 0x0C
+#define NR43 0x12
+#define NR50 0x14
+#define NR51 0x15
+#define NR52 0x16
+#define WAVE_RAM 0x20
+
+#define SQUARE1 0
+#define SQUARE2 1
+#define WAVE 2
+#define NOISE 3
+
+#define LENGTH_ENABLED(_R) ((_R) & 0x40)
+#define FREQUENCY(_LO, _HI) ((_LO) | (((_HI) & 0x7) << 8))
+
+
+static const Byte READ_MASKS[APU_REGISTERS] {
+	0x80, 0x3F, 0x00, 0xFF, 0xBF,
+	0xFF, 0x3F, 0x00, 0xFF, 0xBF,
+	0x7F, 0xFF, 0x9F, 0xFF, 0xBF,
+	0xFF, 0xFF, 0x00, 0x00, 0xBF,
+	0x00, 0x00, 0x70,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF
+};
+
+static const Byte INITIAL_REGISTERS[NR52 + 1] {
+	0x80, 0xBF, 0xF3, 0xFF, 0xBF,
+	0xFF, 0x3F, 0x00, 0xFF, 0xBF,
+	0x7F, 0xFF, 0x9F, 0xFF, 0xBF,
+	0xFF, 0xFF, 0x00, 0x00, 0xBF,
+	0x77, 0xF3, 0xF1
+};
+
+static const u8 DUTY_CYCLES[4][8] {
+	{ 0, 0, 0, 0, 0, 0, 0, 1 },
+	{ 1, 0, 0, 0, 0, 0, 0, 1 },
+	{ 1, 0, 0, 0, 0, 1, 1, 1 },
+	{ 0, 1, 1, 1, 1, 1, 1, 0 }
+};
+
+static inline u16 LengthOf(const unsigned int channel) { return channel == WAVE ? 256 : 64; }
+
+/* the envelope timer reloads with 8 when the period is 0, it just never steps the volume */
+static inline u8 EnvelopePeriodOf(const Byte envelope) { return (envelope & 0x7) ? (envelope & 0x7) : 8; }
+
+
+APU::APU(const bool headless) :
+	_regs{},
+	_power{ true },
+	_channels{},
+	_sweepFrequency{ 0 },
+	_sweepTimer{ 0 },
+	_sweepEnabled{ false },
+	_lfsr{ 0x7FFF },
+	_sequencerStep{ 0 },
+	_lastTicks{ 0 },
+	_frameTime{ 0 },
+	_sampleRate{ 0 },
+	_left{ headless },
+	_right{ headless },
+	_sink{ nullptr },
+	_rateControlEnabled{ false },
+	_rateControl{}
+{
+	setSampleRate(APU_DEFAULT_SAMPLE_RATE);
+	reset();
+}
+APU::~APU() {}
+
+void APU::reset()
+{
+	std::fill(std::begin(_regs), std::end(_regs), static_cast<Byte>(0));
+	std::copy(std::begin(INITIAL_REGISTERS), std::end(INITIAL_REGISTERS), _regs);
+	_power = true;
+
+	for (Channel& channel : _channels)
+		channel = {};
+
+	_sweepFrequency = 0;
+	_sweepTimer = 0;
+	_sweepEnabled = false;
+	_lfsr = 0x7FFF;
+
+	_sequencerStep = 0;
+
+	_lastTicks = 0;
+	_frameTime = 0;
+	_left.clear();
+	_right.clear();
+}
+
+void APU::step(VirtualMachine& vm) { run(vm.cpu.ticks()); }
+
+void APU::sequencerEvent(VirtualMachine& vm, const Ticks when)
+{
+	run(when);
+	if (_power)
+		clockSequencer();
+	vm.scheduler.schedule(SchedulerEvent::FrameSequencer, when + APU_SEQUENCER_PERIOD);
+}
+
+void APU::setSampleRate(const unsigned int rate)
+{
+	_sampleRate = rate;
+	_left.setRates(APU_CLOCK_RATE, rate);
+	_right.setRates(APU_CLOCK_RATE, rate);
+	_left.clear();
+	_right.clear();
+	_rateControl.reset();
+}
+
+bool APU::setAudioSink(AudioSink* sink)
+{
+	CHECK_MSG(!sink || sink->channels() == 2, "the APU needs a stereo audio sink.\n");
+
+	_sink = sink;
+	if (sink && sink->sampleRate() != _sampleRate)
+		setSampleRate(sink->sampleRate());
+	return OK;
+
+	ON_ERROR_RETURN;
+}
+
+void APU::setRateControlEnabled(const bool enabled)
+{
+	_rateControlEnabled = enabled;
+	_rateControl.reset();
+	applyRateRatio(1);
+}
+
+void APU::applyRateRatio(const f64 ratio)
+{
+	/* only the time factor changes; samples already in the buffers stay */
+	_left.setRates(APU_CLOCK_RATE, _sampleRate * ratio);
+	_right.setRates(APU_CLOCK_RATE, _sampleRate * ratio);
+}
+
+void APU::flush(VirtualMachine& vm)
+{
+	run(vm.cpu.ticks());
+	endFrame();
+}
+
+size_t APU::readSamples(VirtualMachine& vm, s16* out, const size_t frames)
+{
+	run(vm.cpu.ticks());
+	endFrame();
+
+	const size_t count = min(frames, _left.samplesAvailable());
+	_left.readSamples(out, count, 2);
+	_right.readSamples(out + 1, count, 2);
+	return count;
+}
+
+void APU::run(const Ticks to)
+{
+	while (_lastTicks < to)
+	{
+		/* long idle spans are split so the blip buffer time never overflows */
+		const u32 elapsed = static_cast<u32>(min<Ticks>(to - _lastTicks, FRAME_TICKS - _frameTime));
+		const u32 end = _frameTime + elapsed;
+		for (unsigned int channel = 0; channel < APU_CHANNELS; channel++)
+			runChannel(channel, _frameTime, end);
+
+		_frameTime = end;
+		_lastTicks += elapsed;
+		if (_frameTime >= FRAME_TICKS)
+			endFrame();
+	}
+}
+
+void APU::runChannel(const unsigned int channel, const u32 from, const u32 to)
+{
+	Channel& c = _channels[channel];
+	if (!c.enabled)
+		return;
+
+	const u32 period = this->period(channel);
+	u32 time = from;
+	while (c.timer <= to - time)
+	{
+		time += c.timer;
+		c.timer = period;
+
+		switch (channel)
+		{
+			case SQUARE1:
+			case SQUARE2:
+				c.position = (c.position + 1) & 0x7;
+				break;
+
+			case WAVE:
+				c.position = (c.position + 1) & 0x1F;
+				break;
+
+			default: {
+				const u16 bit = (_lfsr ^ (_lfsr >> 1)) & 0x1;
+				_lfsr = (_lfsr >> 1) | (bit << 14);
+				if (_regs[NR43] & 0x08)
+					_lfsr = (_lfsr & ~0x40) | (bit << 6);
+			} break;
+		}
+
+		const u8 level = currentLevel(channel);
+		if (level != c.level)
+			setLevel(channel, time, level);
+	}
+	c.timer -= to - time;
+}
+
+void APU::endFrame()
+{
+	_left.endFrame(_frameTime);
+	_right.endFrame(_frameTime);
+	_frameTime = 0;
+
+	if (_sink)
+		deliver();
+}
+
+void APU::deliver()
+{
+	size_t available = _left.samplesAvailable();
+	while (available > 0)
+	{
+		size_t frames = available;
+		s16* out = _sink->lockSamples(frames);
+		if (frames == 0)
+			break;
+
+		_left.readSamples(out, frames, 2);
+		_right.readSamples(out + 1, frames, 2);
+		_sink->unlockSamples(frames);
+		available -= frames;
+	}
+
+	/* keep latency bounded instead of letting the blip buffer fill up */
+	if (available > 0)
+	{
+		_left.readSamples(nullptr, available, 1);
+		_right.readSamples(nullptr, available, 1);
+	}
+
+	if (_rateControlEnabled && _sink->capacityFrames() > 0)
+		applyRateRatio(_rateControl.update(_sink->bufferedFrames(), _sink->capacityFrames()));
+}
+
+void APU::clockSequencer()
+{
+	/* length on even steps, sweep on 2 and 6, envelopes on 7 */
+	if ((_sequencerStep & 0x1) == 0)
+	{
+		for (unsigned int channel = 0; channel < APU_CHANNELS; channel++)
+		{
+			Channel& c = _channels[channel];
+			if (LENGTH_ENABLED(reg(channel, 4)) && c.length > 0 && --c.length == 0)
+				disable(channel);
+		}
+	}
+
+	if (_sequencerStep == 2 || _sequencerStep == 6)
+		clockSweep();
+
+	if (_sequencerStep == 7)
+	{
+		for (unsigned int channel = 0; channel < APU_CHANNELS; channel++)
+		{
+			if (channel == WAVE)
+				continue;
+
+			Channel& c = _channels[channel];
+			const Byte envelope = reg(channel, 2);
+			if (!c.enabled)
+				continue;
+
+			/* a period written after the trigger takes over from the running count */
+			if (c.envelopeTimer == 0)
+				c.envelopeTimer = EnvelopePeriodOf(envelope);
+			if (--c.envelopeTimer != 0)
+				continue;
+
+			c.envelopeTimer = EnvelopePeriodOf(envelope);
+			if ((envelope & 0x7) == 0)
+				continue;
+
+			if ((envelope & 0x08) && c.volume < 15)
+				c.volume++;
+			else if (!(envelope & 0x08) && c.volume > 0)
+				c.volume--;
+			setLevel(channel, _frameTime, currentLevel(channel));
+		}
+	}
+
+	_sequencerStep = (_sequencerStep + 1) & 0x7;
+}
+
+void APU::clockSweep()
+{
+	if (_sweepTimer == 0 || --_sweepTimer != 0)
+		return;
+
+	const u8 period = (_regs[NR10] >> 4) & 0x7;
+	_sweepTimer = period ? period : 8;
+	if (!_sweepEnabled || period == 0)
+		return;
+
+	const u16 frequency = sweepTarget();
+	if (frequency <= 0x7FF && (_regs[NR10] & 0x7))
+	{
+		_sweepFrequency = frequency;
+		reg(SQUARE1, 3) = frequency & 0xFF;
+		reg(SQUARE1, 4) = (reg(SQUARE1, 4) & ~0x7) | (frequency >> 8);
+		sweepTarget();
+	}
+}
+
+u16 APU::sweepTarget()
+{
+	const u16 delta = _sweepFrequency >> (_regs[NR10] & 0x7);
+	const u16 frequency = (_regs[NR10] & 0x08) ? _sweepFrequency - delta : _sweepFrequency + delta;
+	if (frequency > 0x7FF)
+		disable(SQUARE1);
+	return frequency;
+}
+
+void APU::trigger(const unsigned int channel)
+{
+	Channel& c = _channels[channel];
+	c.enabled = dacEnabled(channel);
+	if (c.length == 0)
+		c.length = LengthOf(channel);
+	c.timer = period(channel);
+	c.volume = reg(channel, 2) >> 4;
+	c.envelopeTimer = EnvelopePeriodOf(reg(channel, 2));
+
+	switch (channel)
+	{
+		case WAVE:
+			c.position = 0;
+			break;
+
+		case NOISE:
+			_lfsr = 0x7FFF;
+			break;
+
+		case SQUARE1: {
+			const u8 sweepPeriod = (_regs[NR10] >> 4) & 0x7;
+			_sweepFrequency = FREQUENCY(reg(SQUARE1, 3), reg(SQUARE1, 4));
+			_sweepTimer = sweepPeriod ? sweepPeriod : 8;
+			_sweepEnabled = sweepPeriod != 0 || (_regs[NR10] & 0x7) != 0;
+			if (_regs[NR10] & 0x7)
+				sweepTarget();
+		} break;
+
+		default: break;
+	}
+
+	setLevel(channel, _frameTime, currentLevel(channel));
+}
+
+void APU::disable(const unsigned int channel)
+{
+	_channels[channel].enabled = false;
+	setLevel(channel, _frameTime, 0);
+}
+
+void APU::setLevel(const unsigned int channel, const u32 time, const u8 level)
+{
+	Channel& c = _channels[channel];
+	c.level = level;
+
+	const Byte panning = _regs[NR51];
+	const Byte master = _regs[NR50];
+	const s32 left = (panning & (0x10 << channel)) ? level * (((master >> 4) & 0x7) + 1) * APU_GAIN : 0;
+	const s32 right = (panning & (0x01 << channel)) ? level * ((master & 0x7) + 1) * APU_GAIN : 0;
+
+	if (left != c.left)
+	{
+		_left.addDelta(time, left - c.left);
+		c.left = left;
+	}
+	if (right != c.right)
+	{
+		_right.addDelta(time, right - c.right);
+		c.right = right;
+	}
+}
+
+u8 APU::currentLevel(const unsigned int channel) const
+{
+	const Channel& c = _channels[channel];
+	if (!c.enabled)
+		return 0;
+
+	switch (channel)
+	{
+		case SQUARE1:
+		case SQUARE2:
+			return DUTY_CYCLES[reg(channel, 1) >> 6][c.position] ? c.volume : 0;
+
+		case WAVE: {
+			const Byte sample = _regs[WAVE_RAM + c.position / 2];
+			const u8 code = (_regs[NR32] >> 5) & 0x3;
+			return code ? ((c.position & 0x1) ? sample & 0xF : sample >> 4) >> (code - 1) : 0;
+		}
+
+		default:
+			return (_lfsr & 0x1) ? 0 : c.volume;
+	}
+}
+
+u32 APU::period(const unsigned int channel) const
+{
+	switch (channel)
+	{
+		case SQUARE1:
+		case SQUARE2:
+			return (2048 - FREQUENCY(reg(channel, 3), reg(channel, 4))) * 4;
+
+		case WAVE:
+			return (2048 - FREQUENCY(reg(channel, 3), reg(channel, 4))) * 2;
+
+		default: {
+			const Byte divisor = _regs[NR43] & 0x7;
+			return (divisor ? divisor * 16U : 8U) << (_regs[NR43] >> 4);
+		}
+	}
+}
+
+bool APU::dacEnabled(const unsigned int channel) const
+{
+	return channel == WAVE ? (_regs[NR30] & 0x80) != 0 : (reg(channel, 2) & 0xF8) != 0;
+}
+
+Byte APU::readRegister(VirtualMachine& vm, const Address addr)
+{
+	run(vm.cpu.ticks());
+
+	const unsigned int index = (addr - 0xFF10) % APU_REGISTERS;
+	if (index >= WAVE_RAM)
+		return _regs[index];
+
+	if (index == NR52)
+	{
+		Byte status = (_power ? 0x80 : 0x00) | READ_MASKS[NR52];
+		for (unsigned int channel = 0; channel < APU_CHANNELS; channel++)
+			status |= _channels[channel].enabled ? (0x1 << channel) : 0;
+		return status;
+	}
+
+	return _regs[index] | READ_MASKS[index];
+}
+
+void APU::writeRegister(VirtualMachine& vm, const Address addr, const Byte value)
+{
+	run(vm.cpu.ticks());
+
+	const unsigned int index = (addr - 0xFF10) % APU_REGISTERS;
+	if (index >= WAVE_RAM)
+	{
+		_regs[index] = value;
+		return;
+	}
+
+	if (index == NR52)
+	{
+		const bool power = (value & 0x80) != 0;
+		if (_power && !power)
+		{
+			for (unsigned int channel = 0; channel < APU_CHANNELS; channel++)
+				disable(channel);
+			std::fill(_regs, _regs + NR52, static_cast<Byte>(0));
+		}
+		else if (!_power && power)
+			_sequencerStep = 0;
+		_power = power;
+		return;
+	}
+
+	if (!_power || index > NR52)
+		return;
+
+	_regs[index] = value;
+	if (index == NR50 || index == NR51)
+	{
+		for (unsigned int channel = 0; channel < APU_CHANNELS; channel++)
+			setLevel(channel, _frameTime, _channels[channel].level);
+		return;
+	}
+
+	const unsigned int channel = index / 5;
+	Channel& c = _channels[channel];
+	switch (index % 5)
+	{
+		case 0:
+			if (channel == WAVE && !dacEnabled(WAVE))
+				disable(WAVE);
+			break;
+
+		case 1:
+			c.length = LengthOf(channel) - (channel == WAVE ? value : value & 0x3F);
+			if (channel != WAVE)
+				setLevel(channel, _frameTime, currentLevel(channel));
+			break;
+
+		case 2:
+			if (!dacEnabled(channel))
+				disable(channel);
+			else if (channel == WAVE)
+				setLevel(channel, _frameTime, currentLevel(channel));
+			break;
+
+		case 4:
+			if (value & 0x80)
+				trigger(channel);
+			break;
+
+		default: break;
+	}
+}
+
+void APU::saveState(StateWriter& state) const
+{
+	state.begin(STATE_SECTION('A', 'P', 'U', ' '));
+	state.write(_regs);
+	state.write(_power);
+	for (const Channel& channel : _channels)
+	{
+		state.write(channel.enabled);
+		state.write(channel.length);
+		state.write(channel.volume);
+		state.write(channel.envelopeTimer);
+		state.write(channel.timer);
+		state.write(channel.position);
+		state.write(channel.level);
+		state.write(channel.left);
+		state.write(channel.right);
+	}
+	state.write(_sweepFrequency);
+	state.write(_sweepTimer);
+	state.write(_sweepEnabled);
+	state.write(_lfsr);
+	state.write(_sequencerStep);
+	state.write(_lastTicks);
+	state.write(_frameTime);
+	state.end();
+}
+
+void APU::copyState(const APU& source)
+{
+	std::copy(std::begin(source._regs), std::end(source._regs), std::begin(_regs));
+	_power = source._power;
+	std::copy(std::begin(source._channels), std::end(source._channels), std::begin(_channels));
+	_sweepFrequency = source._sweepFrequency;
+	_sweepTimer = source._sweepTimer;
+	_sweepEnabled = source._sweepEnabled;
+	_lfsr = source._lfsr;
+	_sequencerStep = source._sequencerStep;
+	_lastTicks = source._lastTicks;
+	_frameTime = source._frameTime;
+
+	_left.clear();
+	_right.clear();
+}
+
+void APU::loadState(StateReader& state)
+{
+	state.begin(STATE_SECTION('A', 'P', 'U', ' '));
+	state.read(_regs);
+	state.read(_power);
+	for (Channel& channel : _channels)
+	{
+		state.read(channel.enabled);
+		state.read(channel.length);
+		state.read(channel.volume);
+		state.read(channel.envelopeTimer);
+		state.read(channel.timer);
+		state.read(channel.position);
+		state.read(channel.level);
+		state.read(channel.left);
+		state.read(channel.right);
+	}
+	state.read(_sweepFrequency);
+	state.read(_sweepTimer);
+	state.read(_sweepEnabled);
+	state.read(_lfsr);
+	state.read(_sequencerStep);
+	state.read(_lastTicks);
+	state.read(_frameTime);
+
+	/* samples not delivered yet belong to the replaced timeline */
+	_left.clear();
+	_right.clear();
+}
@@ -0,0 +1,246 @@
+#include "audio_file.h"
+#include "vm.h"
+
+#include <chrono>
+
+#define WAV_HEADER_SIZE 44
+
+
+static inline void PutU16(Byte* dst, const u16 value)
+{
+	dst[0] = static_cast<Byte>(value & 0xFF);
+	dst[1] = static_cast<Byte>(value >> 8);
+}
+
+static inline void PutU32(Byte* dst, const u32 value)
+{
+	PutU16(dst, static_cast<u16>(value & 0xFFFF));
+	PutU16(dst + 2, static_cast<u16>(value >> 16));
+}
+
+
+AudioFileSink::AudioFileSink(const unsigned int sampleRate) :
+	_sampleRate{ sampleRate },
+	_format{ AudioFileFormat::Raw },
+	_open{ false },
+	_file{},
+	_bytesWritten{ 0 },
+	_storage{ new s16[AUDIO_FILE_CHUNK_SAMPLES * AUDIO_FILE_CHUNKS] },
+	_current{ 0 },
+	_used{ 0 },
+	_queued{ AUDIO_FILE_CHUNKS },
+	_free{ AUDIO_FILE_CHUNKS },
+	_writer{},
+	_running{ false },
+	_failed{ false },
+	_frameHash{ FNV_OFFSET_BASIS },
+	_frameHashes{}
+{}
+AudioFileSink::~AudioFileSink()
+{
+	close();
+	delete[] _storage;
+}
+
+bool AudioFileSink::open(const char* filename, const AudioFileFormat format)
+{
+	close();
+
+	_file.open(filename, std::fstream::out | std::fstream::binary | std::fstream::trunc);
+	CHECK_MSG(_file, "unable to open file \"%s\".\n", filename);
+
+	_format = format;
+	_bytesWritten = 0;
+	_failed = false;
+	if (format == AudioFileFormat::Wav)
+	{
+		/* sizes are patched on close */
+		writeHeader(0);
+		CHECK_MSG(!_file.fail(), "write file failed.\n");
+	}
+
+	/* chunk 0 is filled by the emulation, the rest wait in the free list */
+	_current = 0;
+	_used = 0;
+	for (u32 chunk = 1; chunk < AUDIO_FILE_CHUNKS; chunk++)
+		_free.push(chunk);
+
+	_open = true;
+	_running = true;
+	_writer = std::thread{ &AudioFileSink::writeLoop, this };
+	return OK;
+
+	ON_ERROR_CLOSE_STREAM_AND_RETURN(_file);
+}
+
+void AudioFileSink::openHash()
+{
+	close();
+
+	_format = AudioFileFormat::Hash;
+	_current = 0;
+	_used = 0;
+	_frameHash = FNV_OFFSET_BASIS;
+	_frameHashes.clear();
+	_open = true;
+}
+
+bool AudioFileSink::close()
+{
+	if (!_open)
+		return OK;
+
+	_open = false;
+	if (_format == AudioFileFormat::Hash)
+		return OK;
+
+	if (_used > 0)
+		submit();
+
+	_running = false;
+	_writer.join();
+
+	u32 chunk;
+	while (_free.pop(chunk));
+
+	if (_format == AudioFileFormat::Wav && !_failed)
+	{
+		_file.seekp(0, std::fstream::beg);
+		writeHeader(static_cast<u32>(min<u64>(_bytesWritten, 0xFFFFFFFFULL - WAV_HEADER_SIZE)));
+	}
+
+	CHECK_MSG(!_failed && !_file.fail(), "write file failed.\n");
+	_file.close();
+	return OK;
+
+	ON_ERROR_CLOSE_STREAM_AND_RETURN(_file);
+}
+
+void AudioFileSink::markFrame(VirtualMachine& vm)
+{
+	if (_format != AudioFileFormat::Hash || !_open)
+		return;
+
+	/* the APU hands samples over at its own frame boundaries, not the PPU's */
+	vm.apu.flush(vm);
+
+	_frameHashes.push_back(_frameHash);
+	_frameHash = FNV_OFFSET_BASIS;
+}
+
+unsigned int AudioFileSink::sampleRate() const { return _sampleRate; }
+
+s16* AudioFileSink::lockSamples(size_t& frames)
+{
+	if (!_open)
+	{
+		frames = 0;
+		return nullptr;
+	}
+
+	/* hash mode reuses chunk 0 as scratch space */
+	if (_format == AudioFileFormat::Hash)
+	{
+		frames = min<size_t>(frames, AUDIO_FILE_CHUNK_SAMPLES / 2);
+		return _storage;
+	}
+
+	/* every chunk is queued: wait for the writer instead of dropping audio */
+	if (_current == AUDIO_FILE_CHUNKS)
+	{
+		while (!_free.pop(_current))
+			std::this_thread::yield();
+		_used = 0;
+	}
+
+	frames = min<size_t>(frames, (AUDIO_FILE_CHUNK_SAMPLES - _used) / 2);
+	return _storage + static_cast<size_t>(_current) * AUDIO_FILE_CHUNK_SAMPLES + _used;
+}
+
+void AudioFileSink::unlockSamples(const size_t frames)
+{
+	if (_format == AudioFileFormat::Hash)
+	{
+		u64 hash = _frameHash;
+		for (size_t i = 0; i < frames * 2; i++)
+		{
+			/* little endian byte order so hashes match across hosts */
+			hash = (hash ^ (_storage[i] & 0xFF)) * FNV_PRIME;
+			hash = (hash ^ ((_storage[i] >> 8) & 0xFF)) * FNV_PRIME;
+		}
+		_frameHash = hash;
+		return;
+	}
+
+	_used += static_cast<u32>(frames * 2);
+	if (_used == AUDIO_FILE_CHUNK_SAMPLES)
+		submit();
+}
+
+void AudioFileSink::submit()
+{
+	while (!_queued.push({ _current, _used }))
+		std::this_thread::yield();
+
+	if (!_free.pop(_current))
+		_current = AUDIO_FILE_CHUNKS;
+	_used = 0;
+}
+
+void AudioFileSink::writeLoop()
+{
+	ChunkRef chunk;
+	unsigned int idle = 0;
+	for (;;)
+	{
+		if (!_queued.pop(chunk))
+		{
+			if (!_running.load(std::memory_order_acquire) && _queued.empty())
+				break;
+
+			/* a chunk takes a while to fill: do not keep a core busy waiting for it */
+			if (++idle < AUDIO_FILE_IDLE_SPINS)
+				std::this_thread::yield();
+			else std::this_thread::sleep_for(std::chrono::microseconds{ AUDIO_FILE_IDLE_SLEEP_MICROS });
+			continue;
+		}
+		idle = 0;
+
+		s16* samples = _storage + static_cast<size_t>(chunk.index) * AUDIO_FILE_CHUNK_SAMPLES;
+		if (IsBigEndian)
+		{
+			for (u32 i = 0; i < chunk.samples; i++)
+				samples[i] = static_cast<s16>(((samples[i] & 0xFF) << 8) | ((samples[i] >> 8) & 0xFF));
+		}
+
+		if (!_failed)
+		{
+			_file.write(reinterpret_cast<const char*>(samples), static_cast<std::streamsize>(chunk.samples) * sizeof(s16));
+			if (_file.fail())
+				_failed = true;
+			_bytesWritten += static_cast<u64>(chunk.samples) * sizeof(s16);
+		}
+
+		while (!_free.push(chunk.index))
+			std::this_thread::yield();
+	}
+}
+
+void AudioFileSink::writeHeader(const u32 dataBytes)
+{
+	Byte header[WAV_HEADER_SIZE];
+	std::copy_n("RIFF", 4, header);
+	PutU32(header + 4, WAV_HEADER_SIZE - 8 + dataBytes);
+	std::copy_n("WAVEfmt ", 8, header + 8);
+	PutU32(header + 16, 16);
+	PutU16(header + 20, 1);
+	PutU16(header + 22, 2);
+	PutU32(header + 24, _sampleRate);
+	PutU32(header + 28, _sampleRate * 2 * sizeof(s16));
+	PutU16(header + 32, 2 * sizeof(s16));
+	PutU16(header + 34, 16);
+	std::copy_n("data", 4, header + 36);
+	PutU32(header + 40, dataBytes);
+
+	_file.write(reinterpret_cast<const char*>(header), WAV_HEADER_SIZE);
+}
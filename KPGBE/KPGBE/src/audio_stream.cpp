@@ -0,0 +1,53 @@
+#include "audio_stream.h"
+
+
+AudioStream::AudioStream(const unsigned int sampleRate, const size_t capacity) :
+	sf::SoundStream{},
+	_ring{ capacity },
+	_sampleRate{ sampleRate },
+	_pending{ 0 },
+	_silence{},
+	_underruns{ 0 },
+	_overruns{ 0 }
+{
+	initialize(2, sampleRate);
+}
+AudioStream::~AudioStream() { stop(); }
+
+unsigned int AudioStream::sampleRate() const { return _sampleRate; }
+
+s16* AudioStream::lockSamples(size_t& frames)
+{
+	size_t count = frames * 2;
+	s16* samples = _ring.writeRegion(count);
+	frames = count / 2;
+	if (frames == 0)
+		_overruns.fetch_add(1, std::memory_order_relaxed);
+	return samples;
+}
+
+void AudioStream::unlockSamples(const size_t frames) { _ring.commitWrite(frames * 2); }
+
+bool AudioStream::onGetData(Chunk& data)
+{
+	/* SFML has already copied the previous chunk into its own buffer */
+	_ring.commitRead(_pending);
+	_pending = 0;
+
+	size_t count = AUDIO_STREAM_CHUNK;
+	const s16* samples = _ring.readRegion(count);
+	if (count < AUDIO_STREAM_MIN_CHUNK && _ring.size() < AUDIO_STREAM_MIN_CHUNK)
+	{
+		_underruns.fetch_add(1, std::memory_order_relaxed);
+		data.samples = _silence;
+		data.sampleCount = AUDIO_STREAM_MIN_CHUNK;
+		return true;
+	}
+
+	_pending = count;
+	data.samples = samples;
+	data.sampleCount = count;
+	return true;
+}
+
+void AudioStream::onSeek(sf::Time) {}
@@ -0,0 +1,109 @@
+#include "blip.h"
+
+#include <cmath>
+#include <cstring>
+
+#define BLIP_CUTOFF 0.9
+
+
+typedef s16 BlipKernel[BLIP_PHASES][BLIP_WIDTH];
+
+/* Blackman windowed sinc, one row per sub-sample phase, each row summing to one delta unit */
+static const BlipKernel& BuildKernel()
+{
+	static BlipKernel kernel;
+	const f64 pi = 3.14159265358979323846;
+
+	for (unsigned int phase = 0; phase < BLIP_PHASES; phase++)
+	{
+		f64 taps[BLIP_WIDTH];
+		f64 sum = 0;
+		for (unsigned int i = 0; i < BLIP_WIDTH; i++)
+		{
+			const f64 t = static_cast<f64>(i) - (BLIP_HALF_WIDTH - 1) - static_cast<f64>(phase) / BLIP_PHASES;
+			const f64 x = pi * BLIP_CUTOFF * t;
+			const f64 sinc = t == 0 ? 1.0 : std::sin(x) / x;
+			const f64 w = (t + BLIP_HALF_WIDTH) / BLIP_WIDTH;
+			const f64 window = 0.42 - 0.5 * std::cos(2 * pi * w) + 0.08 * std::cos(4 * pi * w);
+			taps[i] = sinc * window;
+			sum += taps[i];
+		}
+
+		s32 total = 0;
+		for (unsigned int i = 0; i < BLIP_WIDTH; i++)
+		{
+			kernel[phase][i] = static_cast<s16>(std::lround(taps[i] / sum * (0x1 << BLIP_DELTA_BITS)));
+			total += kernel[phase][i];
+		}
+
+		/* rounding error goes to the center tap so a step always settles at exactly its delta */
+		kernel[phase][BLIP_HALF_WIDTH - 1] += static_cast<s16>((0x1 << BLIP_DELTA_BITS) - total);
+	}
+	return kernel;
+}
+
+const s16 (&BlipBuffer::Kernel)[BLIP_PHASES][BLIP_WIDTH] = BuildKernel();
+
+
+
+BlipBuffer::BlipBuffer(const bool headless) :
+	_factor{ 0 },
+	_offset{ 0 },
+	_integrator{ 0 },
+	_capacity{ headless ? 0U : BLIP_BUFFER_SIZE },
+	_samples(headless ? 0 : BLIP_BUFFER_SIZE + BLIP_WIDTH)
+{}
+
+void BlipBuffer::setRates(const f64 clockRate, const f64 sampleRate)
+{
+	_factor = static_cast<u64>(std::ceil(sampleRate / clockRate * static_cast<f64>(0x1ULL << BLIP_TIME_BITS)));
+}
+
+void BlipBuffer::clear()
+{
+	_offset = 0;
+	_integrator = 0;
+	std::fill(_samples.begin(), _samples.end(), 0);
+}
+
+void BlipBuffer::endFrame(const u32 time)
+{
+	_offset += time * _factor;
+
+	/* nobody is reading: drop the oldest samples rather than the newest deltas */
+	const size_t available = samplesAvailable();
+	if (!_capacity)
+		_offset -= static_cast<u64>(available) << BLIP_TIME_BITS;
+	else if (available > BLIP_BUFFER_SIZE - BLIP_WIDTH)
+		readSamples(nullptr, available - (BLIP_BUFFER_SIZE - BLIP_WIDTH), 1);
+}
+
+size_t BlipBuffer::readSamples(s16* out, const size_t count, const size_t stride)
+{
+	const size_t n = min(count, samplesAvailable());
+	const size_t used = min(samplesAvailable() + BLIP_WIDTH, _samples.size());
+
+	s32 sum = _integrator;
+	for (size_t i = 0; i < n; i++)
+	{
+		if (i < used)
+			sum += _samples[i];
+
+		const s32 sample = clamp<s32>(sum >> BLIP_DELTA_BITS, -0x8000, 0x7FFF);
+		if (out)
+			out[i * stride] = static_cast<s16>(sample);
+
+		/* high-pass: slowly pulls the DC offset of the channels back to zero */
+		sum -= sample << (BLIP_DELTA_BITS - BLIP_BASS_SHIFT);
+	}
+	_integrator = sum;
+
+	const size_t remaining = used - min(n, used);
+	if (used)
+	{
+		std::memmove(_samples.data(), _samples.data() + (used - remaining), remaining * sizeof(s32));
+		std::fill(_samples.begin() + remaining, _samples.begin() + used, 0);
+	}
+	_offset -= static_cast<u64>(n) << BLIP_TIME_BITS;
+	return n;
+}
@@ -0,0 +1,158 @@
+#include "color.h"
+#include "save_state.h"
+
+#include <cmath>
+#include <mutex>
+
+#define COLOR_CORRECTION_PROFILES 3
+
+
+struct LCDProfile
+{
+	f32 gamma;
+	f32 luminance;
+	f32 matrix[3][3];
+};
+
+/* Approximated response of the original LCD panels (input gamma, brightness and channel bleeding) */
+static const LCDProfile GBC_LCD_PROFILE {
+	2.2f, 0.94f, {
+		{ 0.820f, 0.240f, -0.060f },
+		{ 0.125f, 0.665f, 0.210f },
+		{ 0.195f, 0.075f, 0.730f }
+	}
+};
+static const LCDProfile GBA_LCD_PROFILE {
+	3.6f, 0.96f, {
+		{ 0.800f, 0.275f, -0.075f },
+		{ 0.135f, 0.640f, 0.225f },
+		{ 0.195f, 0.155f, 0.650f }
+	}
+};
+
+static inline u8 expand5(const unsigned int channel) { return static_cast<u8>((channel << 3) | (channel >> 2)); }
+
+static RGBA ApplyLCDProfile(const RGB555 color, const LCDProfile& profile)
+{
+	const f32 in[3] = {
+		std::pow((color & 0x1F) / 31.0f, profile.gamma),
+		std::pow(((color >> 5) & 0x1F) / 31.0f, profile.gamma),
+		std::pow(((color >> 10) & 0x1F) / 31.0f, profile.gamma)
+	};
+
+	u8 out[3];
+	for (int i = 0; i < 3; i++)
+	{
+		f32 value = (profile.matrix[i][0] * in[0] + profile.matrix[i][1] * in[1] + profile.matrix[i][2] * in[2]) * profile.luminance;
+		value = std::pow(::clamp(value, 0.0f, 1.0f), 1.0f / 2.2f);
+		out[i] = static_cast<u8>(value * 255.0f + 0.5f);
+	}
+
+	return { out[0], out[1], out[2], 0xFF };
+}
+
+RGBA ColorTable::convert(const RGB555 color, const ColorCorrection correction)
+{
+	switch (correction)
+	{
+		default:
+		case ColorCorrection::None:
+			return { expand5(color & 0x1F), expand5((color >> 5) & 0x1F), expand5((color >> 10) & 0x1F), 0xFF };
+		case ColorCorrection::GameBoyColorLCD:
+			return ApplyLCDProfile(color, GBC_LCD_PROFILE);
+		case ColorCorrection::GameBoyAdvanceLCD:
+			return ApplyLCDProfile(color, GBA_LCD_PROFILE);
+	}
+}
+
+const RGBA* ColorTable::of(const ColorCorrection correction)
+{
+	static RGBA tables[COLOR_CORRECTION_PROFILES][RGB555_COLORS];
+	static std::once_flag built[COLOR_CORRECTION_PROFILES];
+
+	const unsigned int profile = static_cast<unsigned int>(correction) % COLOR_CORRECTION_PROFILES;
+	std::call_once(built[profile], [profile, correction]() {
+		for (unsigned int color = 0; color < RGB555_COLORS; color++)
+			tables[profile][color] = convert(static_cast<RGB555>(color), correction);
+	});
+	return tables[profile];
+}
+
+
+
+
+ColorPalettes::ColorPalettes() :
+	_ram{},
+	_index{ 0 },
+	_autoIncrement{ false },
+	_table{ ColorTable::of(ColorCorrection::None) },
+	_cache{},
+	_dirty{ 0xFF },
+	_generation{ 0 }
+{}
+
+void ColorPalettes::reset()
+{
+	std::fill(std::begin(_ram), std::end(_ram), static_cast<Byte>(0xFF));
+	_index = 0;
+	_autoIncrement = false;
+	_dirty = 0xFF;
+	_generation++;
+}
+
+void ColorPalettes::setColorTable(const RGBA* table)
+{
+	if (_table != table)
+	{
+		_table = table;
+		_dirty = 0xFF;
+		_generation++;
+	}
+}
+
+Byte ColorPalettes::readSpecification() const { return 0x40 | (_autoIncrement ? 0x80 : 0x00) | _index; }
+void ColorPalettes::writeSpecification(const Byte value)
+{
+	_index = value & 0x3F;
+	_autoIncrement = (value & 0x80) != 0;
+}
+
+Byte ColorPalettes::readData() const { return _ram[_index]; }
+void ColorPalettes::writeData(const Byte value)
+{
+	if (_ram[_index] != value)
+	{
+		_ram[_index] = value;
+		_dirty |= 0x1U << (_index / (PALETTE_COLORS * 2));
+		_generation++;
+	}
+
+	if (_autoIncrement)
+		_index = (_index + 1) & 0x3F;
+}
+
+void ColorPalettes::resolve(const unsigned int index)
+{
+	const Byte* ram = _ram + index * PALETTE_COLORS * 2;
+	for (unsigned int i = 0; i < PALETTE_COLORS; i++)
+		_cache[index][i] = _table[(ram[i * 2] | (ram[i * 2 + 1] << 8)) & 0x7FFF];
+	_dirty &= ~(0x1U << index);
+}
+
+/* Written into the section of the owner */
+void ColorPalettes::saveState(StateWriter& state) const
+{
+	state.write(_ram);
+	state.write(_index);
+	state.write(_autoIncrement);
+}
+
+void ColorPalettes::loadState(StateReader& state)
+{
+	state.read(_ram);
+	state.read(_index);
+	state.read(_autoIncrement);
+	_index &= 0x3F;
+	_dirty = 0xFF;
+	_generation++;
+}
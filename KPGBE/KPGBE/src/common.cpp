@@ -1,5 +1,6 @@
 #include "common.h"
 
+#include <cstring>
 #include <fstream>
 
 
@@ -163,3 +164,19 @@ std::ostream& DumpBytesToStream(std::ostream& os, const void* _mem, const size_t
 
 	return os;
 }
+
+u64 HashBytes(const void* data, const size_t size)
+{
+	const Byte* bytes = static_cast<const Byte*>(data);
+	u64 hash = FNV_OFFSET_BASIS;
+	size_t i = 0;
+	for (; i + sizeof(u64) <= size; i += sizeof(u64))
+	{
+		u64 word;
+		std::memcpy(&word, bytes + i, sizeof(u64));
+		hash = (hash ^ word) * FNV_PRIME;
+	}
+	for (; i < size; ++i)
+		hash = (hash ^ bytes[i]) * FNV_PRIME;
+	return hash;
+}
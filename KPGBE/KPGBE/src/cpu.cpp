@@ -1,27 +1,88 @@
 #include "cpu.h"
 
 #include "vm.h"
-#include "opcodes.h"
+#include "save_state.h"
+
+#define SPEED_SWITCH_TICKS 8200
 
 CPU::CPU() :
 	_stop{ false },
-	_ticks{ 0 }
+	_halted{ false },
+	_haltBug{ false },
+	_speedSwitch{ false },
+	_speedShift{ 0 },
+	_ticks{ 0 },
+	_tickBase{ 0 },
+	_cycleBase{ 0 }
 {}
 CPU::~CPU() {}
 
-void CPU::step(VirtualMachine& vm)
+void CPU::reset()
 {
-	if (_stop)
+	_stop = false;
+	_halted = false;
+	_haltBug = false;
+	_speedSwitch = false;
+	_speedShift = 0;
+	_ticks = 0;
+	_tickBase = 0;
+	_cycleBase = 0;
+}
+
+void CPU::stop(VirtualMachine& vm)
+{
+	if (!_speedSwitch)
+	{
+		_stop = true;
 		return;
+	}
+
+	/* the CPU clock stands still during the switch, then runs at the new rate;
+	 * the scheduler keeps the real clock, so only the timer has to be moved */
+	const Ticks cycles = this->cycles();
+	_ticks += SPEED_SWITCH_TICKS;
+	_tickBase = _ticks;
+	_cycleBase = cycles;
+	_speedShift ^= 1;
+	_speedSwitch = false;
+
+	/* STOP resets the divider */
+	vm.timer.writeRegister(vm, DIV_REGISTER, 0);
+}
+bool CPU::isStopped() const { return _stop; }
 
-	Opcode::executeNext(vm);
+void CPU::halt(VirtualMachine& vm)
+{
+	/* with IME off and an interrupt already pending HALT does not halt,
+	 * and the next opcode byte is fetched twice */
+	if (!vm.ints.master && vm.ints.pending())
+		_haltBug = true;
+	else _halted = true;
 }
 
-void CPU::reset()
+void CPU::saveState(StateWriter& state) const
 {
-	_stop = false;
-	_ticks = 0;
+	state.begin(STATE_SECTION('C', 'P', 'U', ' '));
+	state.write(_stop);
+	state.write(_halted);
+	state.write(_haltBug);
+	state.write(_speedSwitch);
+	state.write(_speedShift);
+	state.write(_ticks);
+	state.write(_tickBase);
+	state.write(_cycleBase);
+	state.end();
 }
 
-void CPU::stop() { _stop = true; }
-bool CPU::isStopped() const { return _stop; }
+void CPU::loadState(StateReader& state)
+{
+	state.begin(STATE_SECTION('C', 'P', 'U', ' '));
+	state.read(_stop);
+	state.read(_halted);
+	state.read(_haltBug);
+	state.read(_speedSwitch);
+	state.read(_speedShift);
+	state.read(_ticks);
+	state.read(_tickBase);
+	state.read(_cycleBase);
+}
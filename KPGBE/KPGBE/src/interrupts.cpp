@@ -1,79 +1,61 @@
 #include "interrupts.h"
 
 #include "vm.h"
+#include "save_state.h"
 
-#define CHECK_INT(interrupt) if(enabled_##interrupt) { int_##interrupt = DISABLED_FLAG; interrupt(vm); }
+#define INTERRUPT_VECTOR(_Index) static_cast<Word>(0x40 + (_Index) * 8)
+#define INTERRUPT_TICKS 20
 
 
 Interrupts::Interrupts() :
 	master{ false },
+	enableDelay{ 0 },
 	enabled{ 0 },
 	flags{ 0 }
 {}
 
-void Interrupts::step(VirtualMachine& vm)
-{
-	if (master && enabled && flags)
-	{
-		CHECK_INT(vblank)
-		CHECK_INT(lcdstat)
-		CHECK_INT(timer)
-		CHECK_INT(serial)
-		CHECK_INT(joypad)
-	}
-}
-
 void Interrupts::reset()
 {
 	master = false;
+	enableDelay = 0;
 	enabled = 0;
 	flags = 0;
 }
 
-void Interrupts::vblank(VirtualMachine& vm)
+void Interrupts::dispatch(VirtualMachine& vm)
 {
-	// TODO: drawFrameBuffer();
-
-	master = false;
-	vm.stack.pushWord(vm.regs.PC);
-	vm.regs.PC = 0x40;
-	vm.cpu.increaseTicks(12);
-}
+	const unsigned int index = count_trailing_zeros(pending());
 
-void Interrupts::lcdstat(VirtualMachine& vm)
-{
+	flags &= ~(0x1 << index);
 	master = false;
+	enableDelay = 0;
 	vm.stack.pushWord(vm.regs.PC);
-	vm.regs.PC = 0x48;
-	vm.cpu.increaseTicks(12);
+	vm.regs.PC = INTERRUPT_VECTOR(index);
+	vm.cpu.increaseTicks(INTERRUPT_TICKS);
 }
 
-void Interrupts::timer(VirtualMachine& vm)
-{
-	master = false;
-	vm.stack.pushWord(vm.regs.PC);
-	vm.regs.PC = 0x50;
-	vm.cpu.increaseTicks(12);
-}
-
-void Interrupts::serial(VirtualMachine& vm)
+void Interrupts::returnFromInterrupt(VirtualMachine& vm)
 {
-	master = false;
-	vm.stack.pushWord(vm.regs.PC);
-	vm.regs.PC = 0x58;
-	vm.cpu.increaseTicks(12);
+	master = true;
+	enableDelay = 0;
+	vm.regs.PC = vm.stack.popWord();
 }
 
-void Interrupts::joypad(VirtualMachine& vm)
+void Interrupts::saveState(StateWriter& state) const
 {
-	master = false;
-	vm.stack.pushWord(vm.regs.PC);
-	vm.regs.PC = 0x60;
-	vm.cpu.increaseTicks(12);
+	state.begin(STATE_SECTION('I', 'N', 'T', 'S'));
+	state.write(master);
+	state.write(enableDelay);
+	state.write(enabled);
+	state.write(flags);
+	state.end();
 }
 
-void Interrupts::returnFromInterrupt(VirtualMachine& vm)
+void Interrupts::loadState(StateReader& state)
 {
-	master = true;
-	vm.regs.PC = vm.stack.popWord();
+	state.begin(STATE_SECTION('I', 'N', 'T', 'S'));
+	state.read(master);
+	state.read(enableDelay);
+	state.read(enabled);
+	state.read(flags);
 }
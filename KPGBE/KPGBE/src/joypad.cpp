@@ -0,0 +1,121 @@
+#include "joypad.h"
+
+#include "vm.h"
+#include "save_state.h"
+
+#include <algorithm>
+
+#define SELECT_DIRECTIONS 0x10
+#define SELECT_BUTTONS 0x20
+
+
+Joypad::Joypad() :
+	_select{ SELECT_DIRECTIONS | SELECT_BUTTONS },
+	_buttons{ 0 },
+	_queue{}
+{}
+
+void Joypad::reset()
+{
+	_select = SELECT_DIRECTIONS | SELECT_BUTTONS;
+	_buttons = 0;
+	_queue.clear();
+}
+
+Byte Joypad::readRegister() const
+{
+	return 0xC0 | _select | (~lines(_select, _buttons) & 0x0F);
+}
+
+void Joypad::writeRegister(VirtualMachine& vm, const Byte value)
+{
+	apply(vm, value & (SELECT_DIRECTIONS | SELECT_BUTTONS), _buttons);
+}
+
+void Joypad::queue(VirtualMachine& vm, const Ticks when, const JoypadButtons& buttons)
+{
+	const Input input{ when, buttons.mask() };
+	if (_queue.empty() || _queue.back().when <= when)
+		_queue.push_back(input);
+	else
+	{
+		const auto it = std::upper_bound(_queue.begin(), _queue.end(), input,
+			[](const Input& a, const Input& b) { return a.when < b.when; });
+		_queue.insert(it, input);
+	}
+	schedule(vm);
+}
+
+void Joypad::press(VirtualMachine& vm, const JoypadButtons& buttons)
+{
+	apply(vm, _select, buttons.mask());
+}
+
+void Joypad::clearQueue(VirtualMachine& vm)
+{
+	_queue.clear();
+	schedule(vm);
+}
+
+void Joypad::schedule(VirtualMachine& vm) const
+{
+	if (!_queue.empty())
+		vm.scheduler.schedule(SchedulerEvent::JoypadInput, _queue.front().when);
+	else vm.scheduler.cancel(SchedulerEvent::JoypadInput);
+}
+
+void Joypad::inputEvent(VirtualMachine& vm, const Ticks when)
+{
+	while (!_queue.empty() && _queue.front().when <= when)
+	{
+		apply(vm, _select, _queue.front().buttons);
+		_queue.pop_front();
+	}
+	schedule(vm);
+}
+
+void Joypad::apply(VirtualMachine& vm, const Byte select, const Byte buttons)
+{
+	/* the interrupt fires when a selected line goes low, i.e. a button becomes visible as pressed */
+	const Byte before = lines(_select, _buttons);
+	_select = select;
+	_buttons = buttons;
+	if (lines(_select, _buttons) & ~before)
+		vm.ints.request(Interrupt::Joypad);
+}
+
+/* Pressed buttons seen on the P10-P13 lines, as set bits */
+Byte Joypad::lines(const Byte select, const Byte buttons) const
+{
+	Byte pressed = 0;
+	if (!(select & SELECT_DIRECTIONS))
+		pressed |= buttons & 0x0F;
+	if (!(select & SELECT_BUTTONS))
+		pressed |= buttons >> 4;
+	return pressed;
+}
+
+void Joypad::saveState(StateWriter& state) const
+{
+	state.begin(STATE_SECTION('J', 'O', 'Y', 'P'));
+	state.write(_select);
+	state.write(_buttons);
+	state.end();
+}
+
+void Joypad::loadState(StateReader& state)
+{
+	state.begin(STATE_SECTION('J', 'O', 'Y', 'P'));
+	state.read(_select);
+	state.read(_buttons);
+
+	/* queued inputs come from the frontend, not from the state */
+	_queue.clear();
+}
+
+void Joypad::copyState(const Joypad& source)
+{
+	_select = source._select;
+	_buttons = source._buttons;
+	_queue.clear();
+}
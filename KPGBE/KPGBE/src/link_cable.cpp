@@ -0,0 +1,160 @@
+#include "link_cable.h"
+
+#include "vm.h"
+
+
+LinkCable::LinkCable() :
+	_mutex{},
+	_changed{},
+	_sides{},
+	_skew{ 0 },
+	_closed{ true }
+{}
+LinkCable::~LinkCable() { disconnect(); }
+
+void LinkCable::connect(VirtualMachine& a, VirtualMachine& b)
+{
+	disconnect();
+
+	/* until the first exchange, take the machines as being at the same point in time */
+	_skew = static_cast<s64>(b.cpu.ticks()) - static_cast<s64>(a.cpu.ticks());
+	_closed = false;
+
+	VirtualMachine* vms[LINK_SIDES] { &a, &b };
+	for (unsigned int side = 0; side < LINK_SIDES; side++)
+	{
+		_sides[side] = {};
+		_sides[side].vm = vms[side];
+		_sides[side].clock = vms[side]->cpu.ticks();
+		_sides[side].end = INVALID_TICKS;
+
+		vms[side]->serial._cable = this;
+		vms[side]->serial._side = side;
+		vms[side]->serial.schedule(*vms[side]);
+	}
+}
+
+void LinkCable::disconnect()
+{
+	close();
+	for (Side& side : _sides)
+	{
+		if (!side.vm)
+			continue;
+
+		side.vm->serial._cable = nullptr;
+		side.vm->serial.schedule(*side.vm);
+		side = {};
+	}
+}
+
+void LinkCable::close()
+{
+	std::lock_guard<std::mutex> lock{ _mutex };
+	_closed = true;
+	_changed.notify_all();
+}
+
+void LinkCable::resync(const unsigned int side, const Ticks now)
+{
+	std::lock_guard<std::mutex> lock{ _mutex };
+	_sides[side].clock = now;
+	_skew = static_cast<s64>(_sides[1].clock) - static_cast<s64>(_sides[0].clock);
+	_changed.notify_all();
+}
+
+void LinkCable::publish(const unsigned int side, const Ticks now)
+{
+	std::lock_guard<std::mutex> lock{ _mutex };
+	_sides[side].clock = now;
+	_changed.notify_all();
+}
+
+void LinkCable::send(const unsigned int side, const Byte data, const Ticks now, const Ticks end)
+{
+	std::lock_guard<std::mutex> lock{ _mutex };
+	Side& self = _sides[side];
+	self.clock = now;
+	self.listening = false;
+	self.sending = true;
+	self.answered = false;
+	self.data = data;
+	self.end = end;
+
+	Side& peer = _sides[side ^ 1];
+	if (!_closed && peer.listening)
+	{
+		exchange(side);
+		peer.delivered = true;
+	}
+	_changed.notify_all();
+}
+
+Byte LinkCable::receive(const unsigned int side, const Ticks now)
+{
+	std::unique_lock<std::mutex> lock{ _mutex };
+	Side& self = _sides[side];
+	const Side& peer = _sides[side ^ 1];
+
+	/* our clock is past our own transfer: a peer blocked on a later transfer can go on */
+	self.clock = now;
+	_changed.notify_all();
+	_changed.wait(lock, [this, side, &self, &peer]() {
+		return _closed || self.answered || (!peer.listening && peerClock(side) >= static_cast<s64>(self.end));
+	});
+
+	self.sending = false;
+	return self.answered ? self.answer : 0xFF;
+}
+
+bool LinkCable::listen(const unsigned int side, const Byte data, const Ticks now, Byte& received)
+{
+	std::lock_guard<std::mutex> lock{ _mutex };
+	Side& self = _sides[side];
+	Side& peer = _sides[side ^ 1];
+
+	self.clock = now;
+	self.data = data;
+	if (self.delivered)
+	{
+		self.delivered = false;
+		received = self.received;
+		return true;
+	}
+
+	if (_closed || !peer.sending || peer.answered)
+	{
+		self.listening = true;
+		_changed.notify_all();
+		return false;
+	}
+
+	exchange(side ^ 1);
+	received = self.received;
+	_changed.notify_all();
+	return true;
+}
+
+void LinkCable::exchange(const unsigned int sender)
+{
+	Side& from = _sides[sender];
+	Side& to = _sides[sender ^ 1];
+
+	/* side 1 time minus side 0 time, taking the end of the transfer as now on the sending side */
+	const s64 skew = static_cast<s64>(to.clock) - static_cast<s64>(from.end);
+	_skew = sender == 0 ? skew : -skew;
+
+	from.answered = true;
+	from.answer = to.data;
+	to.listening = false;
+	to.received = from.data;
+}
+
+void LinkCable::cancel(const unsigned int side)
+{
+	std::lock_guard<std::mutex> lock{ _mutex };
+	_sides[side].listening = false;
+	_sides[side].delivered = false;
+	_sides[side].sending = false;
+	_changed.notify_all();
+}
@@ -0,0 +1,251 @@
+#include "lockstep.h"
+#include "vm.h"
+
+#include <algorithm>
+#include <cstring>
+
+#define NO_CLAIM 0x100
+
+
+Lockstep::Lockstep(const VirtualMachine& source, const size_t instances) :
+	_group(instances),
+	_machines{},
+	_refs{},
+	_claims{},
+	_status{},
+	_states{},
+	_keys{},
+	_serialized{},
+	_remap{},
+	_free{},
+	_splits{},
+	_order{},
+	_live{ 0 },
+	_mergeInterval{ LOCKSTEP_DEFAULT_MERGE_INTERVAL },
+	_mergeWait{ LOCKSTEP_DEFAULT_MERGE_INTERVAL },
+	_nextMerge{ LOCKSTEP_DEFAULT_MERGE_INTERVAL },
+	_steps{ 0 },
+	_machineFrames{ 0 }
+{
+	reset(source);
+}
+
+Lockstep::~Lockstep() {}
+
+void Lockstep::reset(const VirtualMachine& source)
+{
+	_machines.clear();
+	_refs.clear();
+	_claims.clear();
+	_status.clear();
+	_states.clear();
+	_keys.clear();
+	_serialized.clear();
+	_remap.clear();
+	_free.clear();
+	_live = 0;
+	_mergeWait = _mergeInterval;
+	_nextMerge = _mergeInterval;
+	_steps = 0;
+	_machineFrames = 0;
+
+	const u32 group = add(source.clone(true));
+	std::fill(_group.begin(), _group.end(), group);
+	_refs[group] = static_cast<u32>(_group.size());
+}
+
+void Lockstep::step(const Byte* buttons)
+{
+	const size_t groups = _machines.size();
+	for (size_t g = 0; g < groups; g++)
+		_claims[g] = NO_CLAIM;
+	_splits.clear();
+
+	/* the first buttons seen in a group keep its machine; instances holding others
+	 * move to clones, all taken before anything runs */
+	for (size_t i = 0; i < _group.size(); i++)
+	{
+		const u32 group = _group[i];
+		if (_claims[group] == NO_CLAIM)
+			_claims[group] = buttons[i];
+		else if (_claims[group] != buttons[i])
+			_group[i] = split(group, buttons[i]);
+	}
+
+	for (size_t g = 0; g < _machines.size(); g++)
+	{
+		if (!_refs[g])
+			continue;
+
+		VirtualMachine& vm = *_machines[g];
+		vm.joypad.press(vm, JoypadButtons::fromMask(static_cast<Byte>(_claims[g])));
+		_status[g] = vm.runFrame();
+		_machineFrames++;
+	}
+
+	if (++_steps >= _nextMerge)
+	{
+		/* passes that find nothing come less and less often */
+		if (_live > 1 && merge())
+			_mergeWait = _mergeInterval;
+		else _mergeWait = min<unsigned int>(_mergeWait * 2, max<unsigned int>(_mergeInterval, LOCKSTEP_MAX_MERGE_INTERVAL));
+		_nextMerge = _steps + _mergeWait;
+	}
+}
+
+VirtualMachine& Lockstep::own(const size_t instance)
+{
+	const u32 group = _group[instance];
+	if (_refs[group] > 1)
+	{
+		const u32 to = add(_machines[group]->clone(true));
+		_status[to] = _status[group];
+		_refs[group]--;
+		_refs[to]++;
+		_group[instance] = to;
+	}
+	return *_machines[_group[instance]];
+}
+
+void Lockstep::setMergeInterval(const unsigned int steps)
+{
+	_mergeInterval = steps > 0 ? steps : 1;
+	_mergeWait = _mergeInterval;
+	_nextMerge = _steps + _mergeInterval;
+}
+
+u32 Lockstep::split(const u32 group, const Byte buttons)
+{
+	for (const Split& split : _splits)
+		if (split.group == group && split.buttons == buttons)
+		{
+			_refs[group]--;
+			_refs[split.to]++;
+			return split.to;
+		}
+
+	const u32 to = add(_machines[group]->clone(true));
+	_claims[to] = buttons;
+	_refs[group]--;
+	_refs[to]++;
+	_splits.push_back({ group, buttons, to });
+	return to;
+}
+
+u32 Lockstep::add(std::unique_ptr<VirtualMachine> machine)
+{
+	u32 group;
+	if (!_free.empty())
+	{
+		group = _free.back();
+		_free.pop_back();
+		_machines[group] = std::move(machine);
+	}
+	else
+	{
+		group = static_cast<u32>(_machines.size());
+		_machines.push_back(std::move(machine));
+		_refs.push_back(0);
+		_claims.push_back(NO_CLAIM);
+		_status.push_back(RunStatus::CyclesDone);
+		_states.emplace_back();
+		_keys.push_back(0);
+		_serialized.push_back(false);
+		_remap.push_back(group);
+	}
+	_refs[group] = 0;
+	_live++;
+	return group;
+}
+
+void Lockstep::release(const u32 group)
+{
+	_machines[group].reset();
+	_refs[group] = 0;
+	_free.push_back(group);
+	_live--;
+}
+
+/* Groups whose whole state is equal become one again. Only groups with the same
+ * registers and clock are candidates, and their states are compared for real before
+ * merging; returns whether any group merged */
+bool Lockstep::merge()
+{
+	_order.clear();
+	for (size_t g = 0; g < _machines.size(); g++)
+	{
+		_remap[g] = static_cast<u32>(g);
+		if (!_refs[g])
+			continue;
+
+		_keys[g] = key(*_machines[g]);
+		_serialized[g] = false;
+		_order.push_back(static_cast<u32>(g));
+	}
+
+	std::sort(_order.begin(), _order.end(), [this](u32 a, u32 b) { return _keys[a] < _keys[b]; });
+
+	bool merged = false;
+	for (size_t i = 1; i < _order.size(); i++)
+	{
+		const u32 group = _order[i];
+		for (size_t j = i; j-- > 0 && _keys[_order[j]] == _keys[group];)
+		{
+			const u32 into = _order[j];
+			if (_remap[into] == into && equal(group, into))
+			{
+				_remap[group] = into;
+				merged = true;
+				break;
+			}
+		}
+	}
+	if (!merged)
+		return false;
+
+	for (size_t i = 0; i < _group.size(); i++)
+	{
+		const u32 group = _group[i];
+		if (_remap[group] != group)
+		{
+			_refs[group]--;
+			_refs[_remap[group]]++;
+			_group[i] = _remap[group];
+		}
+	}
+
+	for (size_t g = 0; g < _machines.size(); g++)
+		if (_machines[g] && !_refs[g])
+			release(static_cast<u32>(g));
+	return true;
+}
+
+/* Memory first, which mostly costs nothing since converged groups share its pages;
+ * each state is serialized at most once per pass */
+bool Lockstep::equal(const u32 a, const u32 b)
+{
+	if (!_machines[a]->mmu.equalMemory(_machines[b]->mmu))
+		return false;
+
+	for (const u32 group : { a, b })
+	{
+		if (_serialized[group])
+			continue;
+		_machines[group]->saveState(_states[group]);
+		_serialized[group] = true;
+	}
+
+	const SaveState& x = _states[a];
+	const SaveState& y = _states[b];
+	return x.size() == y.size() && std::memcmp(x.data(), y.data(), x.size()) == 0;
+}
+
+u64 Lockstep::key(const VirtualMachine& vm)
+{
+	const u64 words[] {
+		vm.cpu.ticks(),
+		static_cast<u64>(vm.regs.AF) | static_cast<u64>(vm.regs.BC) << 16 | static_cast<u64>(vm.regs.DE) << 32 | static_cast<u64>(vm.regs.HL) << 48,
+		static_cast<u64>(vm.regs.SP) | static_cast<u64>(vm.regs.PC) << 16
+	};
+	return HashBytes(words, sizeof(words));
+}
@@ -1,28 +1,84 @@
 #include "mmu.h"
 
 #include "range.h"
+#include "vm.h"
+#include "save_state.h"
 
 
 #define INTERNAL_RAM_SIZE 8_KB
+#define HIGH_RAM_SIZE 0x7F
+#define DMA_REGISTER 0xFF46
+#define JOYPAD_REGISTER 0xFF00
+#define INTERRUPT_FLAGS_REGISTER 0xFF0F
+#define SPEED_REGISTER 0xFF4D
+#define BOOT_ROM_REGISTER 0xFF50
+#define INTERRUPT_ENABLE_REGISTER 0xFFFF
 
 
 #define ADDRESS_RANGE(_From, _ToExclusive) typedef DECL_RANGE(Address, (_From), (_ToExclusive) - 1) 
 ADDRESS_RANGE(0, 0x100) GameBoyBiosRange;
 ADDRESS_RANGE(0, 0x800) GameBoyColorBiosRange;
+ADDRESS_RANGE(0x100, 0x200) CartridgeHeaderRange;
 ADDRESS_RANGE(0xC000, 0xE000) InternalRamRange;
 ADDRESS_RANGE(0xE000, 0xFE00) EchoInternalRamRange;
+ADDRESS_RANGE(0xFF01, 0xFF03) SerialRegistersRange;
+ADDRESS_RANGE(0xFF04, 0xFF08) TimerRegistersRange;
+ADDRESS_RANGE(0xFF10, 0xFF27) SoundRegistersRange;
+ADDRESS_RANGE(0xFF30, 0xFF40) WaveRAMRange;
+ADDRESS_RANGE(0xFF40, 0xFF4C) LCDRegistersRange;
+ADDRESS_RANGE(0xFF4F, 0xFF50) VRAMBankRegisterRange;
+ADDRESS_RANGE(0xFF68, 0xFF6C) ColorPaletteRegistersRange;
+ADDRESS_RANGE(0xFF80, 0xFFFF) HighRamRange;
 
 
-MMU::MMU(const Bios::Type bios) :
+MMU::MMU(VirtualMachine& vm, const Bios::Type bios) :
+	_vm{ vm },
 	_bios{ bios },
 	_biosMode{ true },
-	_internalRAM{ INTERNAL_RAM_SIZE }
+	_internalRAM{ INTERNAL_RAM_SIZE },
+	_highRAM{ HIGH_RAM_SIZE },
+	_rom{}
 {}
 MMU::~MMU()
 {
 
 }
 
+void MMU::reset()
+{
+	_biosMode = true;
+	_internalRAM.clear();
+	_highRAM.clear();
+}
+
+bool MMU::loadRom(const char* filename)
+{
+	FileData file;
+	CHECK(SUCCESS(file.read(filename)));
+	loadRom(file.data, file.size);
+	return OK;
+
+	ON_ERROR_RETURN;
+}
+
+void MMU::loadRom(const Byte* data, const size_t size)
+{
+	_rom = std::make_shared<const std::vector<Byte>>(data, data + size);
+}
+
+void MMU::copyState(const MMU& source)
+{
+	_rom = source._rom;
+	_biosMode = source._biosMode;
+	_internalRAM = source._internalRAM;
+	_highRAM = source._highRAM;
+}
+
+bool MMU::equalMemory(const MMU& mmu) const
+{
+	return _internalRAM.equals(mmu._internalRAM) && _highRAM.equals(mmu._highRAM);
+}
+
 Byte MMU::read(const Address addr) const
 {
 	switch (addr & 0xF000)
@@ -33,25 +89,24 @@ Byte MMU::read(const Address addr) const
 			{
 				if (GameBoyBiosRange::contains(addr))
 					return _bios[addr];
-				else if (GameBoyColorBiosRange::contains(addr) && _bios.isGBC())
+				else if (GameBoyColorBiosRange::contains(addr) && _bios.isGBC() && !CartridgeHeaderRange::contains(addr))
 					return _bios[addr];
 			}
 		case 0x1000:
 		case 0x2000:
 		case 0x3000:
-			break;
 
-		/* switchable ROM bank */
+		/* switchable ROM bank (always bank #1: no bank controllers yet) */
 		case 0x4000:
 		case 0x5000:
 		case 0x6000:
 		case 0x7000:
-			break;
+			return _rom && addr < _rom->size() ? (*_rom)[addr] : 0;
 
 		/* Video RAM */
 		case 0x8000:
 		case 0x9000:
-			break;
+			return _vm.ppu.readVRAM(addr);
 
 		/* switchable RAM bank */
 		case 0xA000:
@@ -73,13 +128,21 @@ Byte MMU::read(const Address addr) const
 
 			/* OAM */
 			else if (addr < 0xFEA0)
-				break;
+				return _vm.ppu.readOAM(addr);
 
 			/* ??? */
-			else if (addr < 0xFF80);
+			else if (addr < 0xFF00);
+
+			/* I/O ports */
+			else if (addr < 0xFF80)
+				return readIO(addr);
+
+			/* High RAM */
+			else if (HighRamRange::contains(addr))
+				return _highRAM.read(HighRamRange::index(addr));
 
 			/* Interrupts */
-			else break;
+			else return _vm.ints.enabled;
 			break;
 	}
 
@@ -107,6 +170,7 @@ void MMU::write(const Address addr, const Byte value)
 		/* Video RAM */
 		case 0x8000:
 		case 0x9000:
+			_vm.ppu.writeVRAM(addr, value);
 			break;
 
 		/* switchable RAM bank */
@@ -130,17 +194,87 @@ void MMU::write(const Address addr, const Byte value)
 
 			/* OAM */
 			else if (addr < 0xFEA0)
-				break;
+				_vm.ppu.writeOAM(addr, value);
 
 			/* ??? */
-			else if (addr < 0xFF80);
+			else if (addr < 0xFF00);
+
+			/* I/O ports */
+			else if (addr < 0xFF80)
+				writeIO(addr, value);
+
+			/* High RAM */
+			else if (HighRamRange::contains(addr))
+				_highRAM.write(HighRamRange::index(addr), value);
 
 			/* Interrupts */
-			else break;
+			else _vm.ints.enabled = value;
 			break;
 	}
 }
 
+Byte MMU::readIO(const Address addr) const
+{
+	if (addr == JOYPAD_REGISTER)
+		return _vm.joypad.readRegister();
+	if (addr == INTERRUPT_FLAGS_REGISTER)
+		return _vm.ints.readFlags();
+	if (addr == SPEED_REGISTER)
+		return _bios.isGBC() ? _vm.cpu.readSpeedRegister() : 0xFF;
+	if (LCDRegistersRange::contains(addr) || VRAMBankRegisterRange::contains(addr) || ColorPaletteRegistersRange::contains(addr))
+		return _vm.ppu.readRegister(addr);
+	if (SerialRegistersRange::contains(addr))
+		return _vm.serial.readRegister(addr);
+	if (TimerRegistersRange::contains(addr))
+		return _vm.timer.readRegister(_vm, addr);
+	if (SoundRegistersRange::contains(addr) || WaveRAMRange::contains(addr))
+		return _vm.apu.readRegister(_vm, addr);
+
+	return 0xFF;
+}
+
+void MMU::writeIO(const Address addr, const Byte value)
+{
+	if (addr == DMA_REGISTER)
+		dma(value);
+	else if (addr == JOYPAD_REGISTER)
+		_vm.joypad.writeRegister(_vm, value);
+	else if (addr == INTERRUPT_FLAGS_REGISTER)
+		_vm.ints.writeFlags(value);
+	else if (addr == SPEED_REGISTER)
+	{
+		if (_bios.isGBC())
+			_vm.cpu.writeSpeedRegister(value);
+	}
+	else if (addr == BOOT_ROM_REGISTER)
+	{
+		if (value)
+			_biosMode = false;
+	}
+	else if (LCDRegistersRange::contains(addr) || VRAMBankRegisterRange::contains(addr) || ColorPaletteRegistersRange::contains(addr))
+	{
+		/* LCDC may switch the LCD on or off: catch up first and move the mode event */
+		_vm.ppu.step(_vm);
+		_vm.ppu.writeRegister(addr, value);
+		_vm.ppu.schedule(_vm);
+	}
+	else if (SerialRegistersRange::contains(addr))
+		_vm.serial.writeRegister(_vm, addr, value);
+	else if (TimerRegistersRange::contains(addr))
+		_vm.timer.writeRegister(_vm, addr, value);
+	else if (SoundRegistersRange::contains(addr) || WaveRAMRange::contains(addr))
+		_vm.apu.writeRegister(_vm, addr, value);
+}
+
+void MMU::dma(const Byte source)
+{
+	Byte data[OAM_SIZE];
+	const Address base = static_cast<Address>(source) << 8;
+	for (Address i = 0; i < OAM_SIZE; i++)
+		data[i] = read(base + i);
+	_vm.ppu.dma(data);
+}
+
 Word MMU::readWord(const Address addr) const
 {
 	return static_cast<Word>((read(addr) & 0xffU) << 8) | static_cast<Word>(read(addr + 1) & 0xffU);
@@ -150,3 +284,22 @@ void MMU::writeWord(const Address addr, const Word value)
 	write(addr, static_cast<Byte>((value >> 8) & 0xffU));
 	write(addr + 1, static_cast<Byte>(value & 0xffU));
 }
+
+void MMU::saveState(StateWriter& state) const
+{
+	state.begin(STATE_SECTION('M', 'M', 'U', ' '));
+	state.write(_biosMode);
+	state.end();
+
+	_internalRAM.saveState(state, STATE_SECTION('W', 'R', 'A', 'M'));
+	_highRAM.saveState(state, STATE_SECTION('H', 'R', 'A', 'M'));
+}
+
+void MMU::loadState(StateReader& state)
+{
+	state.begin(STATE_SECTION('M', 'M', 'U', ' '));
+	state.read(_biosMode);
+
+	_internalRAM.loadState(state, STATE_SECTION('W', 'R', 'A', 'M'));
+	_highRAM.loadState(state, STATE_SECTION('H', 'R', 'A', 'M'));
+}
@@ -0,0 +1,188 @@
+#include "movie.h"
+
+#include "vm.h"
+
+#include <cstring>
+#include <fstream>
+
+
+Movie::Movie() :
+	_machine{ static_cast<u8>(Bios::Type::GameBoy) },
+	_flags{ 0 },
+	_romHash{ 0 },
+	_start{},
+	_inputs{},
+	_frameHashes{},
+	_frames{ 0 },
+	_scratch{}
+{}
+
+bool Movie::read(const char* filename)
+{
+	FileData file;
+	MovieHeader header;
+	const Byte* cursor;
+	u64 hashes;
+
+	CHECK(SUCCESS(file.read(filename)));
+	CHECK_MSG(file.size >= sizeof(MovieHeader), "invalid movie file.\n");
+
+	std::memcpy(&header, file.data, sizeof(header));
+	CHECK_MSG(header.magic == MOVIE_MAGIC, "invalid movie file.\n");
+	CHECK_MSG(header.version == MOVIE_VERSION, "unsupported movie version %u.\n", header.version);
+
+	hashes = (header.flags & MOVIE_FLAG_FRAME_HASHES) ? header.frames : 0;
+	CHECK_MSG(file.size == sizeof(header) + header.stateSize + header.inputs * sizeof(MovieInput) + hashes * sizeof(u64),
+		"corrupt movie file.\n");
+	CHECK_MSG((header.flags & MOVIE_FLAG_POWER_ON) || header.stateSize > 0, "corrupt movie file.\n");
+
+	_machine = header.machine;
+	_flags = header.flags;
+	_romHash = header.romHash;
+	_frames = header.frames;
+
+	cursor = file.data + sizeof(header);
+	if (header.stateSize > 0)
+		_start.assign(cursor, header.stateSize);
+	else _start.clear();
+	cursor += header.stateSize;
+
+	_inputs.resize(header.inputs);
+	std::memcpy(_inputs.data(), cursor, header.inputs * sizeof(MovieInput));
+	cursor += header.inputs * sizeof(MovieInput);
+
+	_frameHashes.resize(static_cast<size_t>(hashes));
+	std::memcpy(_frameHashes.data(), cursor, static_cast<size_t>(hashes) * sizeof(u64));
+	return OK;
+
+	ON_ERROR_RETURN;
+}
+
+bool Movie::write(const char* filename) const
+{
+	std::fstream f{ filename, std::fstream::out | std::fstream::binary };
+	CHECK_MSG(f, "unable to open file \"%s\".\n", filename);
+
+	{
+		MovieHeader header{};
+		header.magic = MOVIE_MAGIC;
+		header.version = MOVIE_VERSION;
+		header.machine = _machine;
+		header.flags = _flags;
+		header.romHash = _romHash;
+		header.frames = _frames;
+		header.stateSize = static_cast<u32>(_start.size());
+		header.inputs = static_cast<u32>(_inputs.size());
+
+		f.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		f.write(reinterpret_cast<const char*>(_start.data()), _start.size());
+		f.write(reinterpret_cast<const char*>(_inputs.data()), _inputs.size() * sizeof(MovieInput));
+		f.write(reinterpret_cast<const char*>(_frameHashes.data()), _frameHashes.size() * sizeof(u64));
+	}
+	CHECK_MSG(!f.fail(), "write file failed.\n");
+
+	f.close();
+	return OK;
+
+	ON_ERROR_CLOSE_STREAM_AND_RETURN(f);
+}
+
+void Movie::clear()
+{
+	_flags = 0;
+	_romHash = 0;
+	_start.clear();
+	_inputs.clear();
+	_frameHashes.clear();
+	_frames = 0;
+}
+
+void Movie::record(VirtualMachine& vm, const u64 romHash, const bool powerOn, const bool frameHashes)
+{
+	clear();
+	_machine = static_cast<u8>(vm.mmu.bios().isGBC() ? Bios::Type::GameBoyColor : Bios::Type::GameBoy);
+	_romHash = romHash;
+	_flags = (powerOn ? MOVIE_FLAG_POWER_ON : 0) | (frameHashes ? MOVIE_FLAG_FRAME_HASHES : 0);
+
+	if (powerOn)
+		vm.reset();
+	else vm.saveState(_start);
+
+	/* inputs queued before the recording started would not be part of it */
+	vm.joypad.clearQueue(vm);
+}
+
+void Movie::input(VirtualMachine& vm, const JoypadButtons& buttons) { input(vm, vm.cpu.ticks(), buttons); }
+
+void Movie::input(VirtualMachine& vm, const Ticks when, const JoypadButtons& buttons)
+{
+	/* an input due now applies after the next instruction; stamped with the current tick,
+	 * a replay could apply it together with events that fired at the end of the last one */
+	MovieInput input{};
+	input.when = max(when, vm.cpu.ticks() + 1);
+	input.buttons = buttons.mask();
+	_inputs.push_back(input);
+
+	vm.joypad.queue(vm, input.when, buttons);
+}
+
+void Movie::frame(const VirtualMachine& vm)
+{
+	_frames++;
+	if (hasFrameHashes())
+		_frameHashes.push_back(stateHash(vm));
+}
+
+bool Movie::start(VirtualMachine& vm, const u64 romHash) const
+{
+	CHECK_MSG(romHash == _romHash, "the movie was recorded with another rom.\n");
+	CHECK_MSG(vm.mmu.bios().isGBC() == (machine() == Bios::Type::GameBoyColor), "the movie was recorded on another machine.\n");
+
+	if (isPowerOn())
+		vm.reset();
+	else CHECK(SUCCESS(vm.loadState(_start)));
+
+	vm.joypad.clearQueue(vm);
+	for (const MovieInput& input : _inputs)
+		vm.joypad.queue(vm, input.when, JoypadButtons::fromMask(input.buttons));
+	return OK;
+
+	ON_ERROR_RETURN;
+}
+
+bool Movie::replay(VirtualMachine& vm, const u64 romHash, MovieReplay& result, const bool verify) const
+{
+	result.frames = 0;
+	result.desyncFrame = INVALID_TICKS;
+	result.stopped = false;
+
+	CHECK(SUCCESS(start(vm, romHash)));
+
+	while (result.frames < _frames)
+	{
+		const RunStatus status = vm.runFrame();
+		if (status == RunStatus::Stopped)
+		{
+			result.stopped = true;
+			break;
+		}
+		if (status != RunStatus::FrameComplete)
+			continue;
+
+		if (verify && hasFrameHashes() && stateHash(vm) != _frameHashes[static_cast<size_t>(result.frames)])
+		{
+			result.desyncFrame = result.frames;
+			break;
+		}
+		result.frames++;
+	}
+	return OK;
+
+	ON_ERROR_RETURN;
+}
+
+u64 Movie::stateHash(const VirtualMachine& vm) const
+{
+	vm.saveState(_scratch);
+	return _scratch.hash();
+}
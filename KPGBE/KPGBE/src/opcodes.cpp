@@ -58,9 +58,11 @@ void Opcode::operator() (VirtualMachine& vm, Word arg) const
 const Opcode& Opcode::of(Byte code) { return OPCODES[code]; }
 Ticks Opcode::ticksOf(Byte code) { return TICKS[code]; }
 
-void Opcode::executeNext(VirtualMachine& vm)
+void Opcode::executeNext(VirtualMachine& vm, const bool repeatFetch)
 {
-	Byte opcode_id = vm.mmu.read(vm.regs.PC++);
+	Byte opcode_id = vm.mmu.read(vm.regs.PC);
+	if (!repeatFetch)
+		vm.regs.PC++;
 	const Opcode& op = OPCODES[opcode_id];
 
 	switch (op._type)
@@ -344,7 +346,7 @@ opfuncv(rrca) {
 	CLEAR_FLAG(ZERO_FLAG);
 	CLEAR_FLAG(HALFCARRY_FLAG);
 }
-opfuncb(stop) { __CPU.stop(); }
+opfuncb(stop) { __CPU.stop(__ARGS); }
 opfuncw(ld_de_nn) { DE = OPERAND; }
 opfuncv(ld_dep_a) { WriteByte(DE, A); }
 opfuncv(inc_de) { DE++; }
@@ -532,12 +534,7 @@ opfuncv(ld_hlp_d) { WriteByte(HL, D); }
 opfuncv(ld_hlp_e) { WriteByte(HL, E); }
 opfuncv(ld_hlp_h) { WriteByte(HL, H); }
 opfuncv(ld_hlp_l) { WriteByte(HL, L); }
-opfuncv(halt) {
-	if (__INT.master) {
-		//HALT EXECUTION UNTIL AN INTERRUPT OCCURS
-	}
-	else PC++;
-}
+opfuncv(halt) { __CPU.halt(__ARGS); }
 opfuncv(ld_hlp_a) { WriteByte(HL, A); }
 
 opfuncv(ld_a_b) { A = B; }
@@ -771,7 +768,7 @@ opfuncv(rst_28) { STACK_WRITE_WORD(PC); PC = 0x0028; }
 opfuncb(ld_ff_ap_n) { A = ReadByte(0xFF00 + OPERAND); }
 opfuncv(pop_af) { AF = STACK_READ_WORD(); }
 opfuncv(ld_a_ff_c) { A = ReadByte(0xFF00 + C); }
-opfuncv(di_inst) { __INT.master = false; }
+opfuncv(di_inst) { __INT.disable(); }
 opfuncv(push_af) { STACK_WRITE_WORD(AF); }
 opfuncb(or_n) { OR(OPERAND); }
 opfuncv(rst_30) { STACK_WRITE_WORD(PC); PC = 0x0030; }
@@ -787,7 +784,7 @@ opfuncb(ld_hl_sp_n) {
 }
 opfuncv(ld_sp_hl) { SP = HL; }
 opfuncw(ld_a_nnp) { A = ReadByte(OPERAND); }
-opfuncv(ei) { __INT.master = true; }
+opfuncv(ei) { __INT.enable(); }
 opfuncb(cp_n) {
 	SET_FLAG(SUBTRACT_FLAG);
 
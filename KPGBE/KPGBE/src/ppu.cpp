@@ -0,0 +1,707 @@
+#include "ppu.h"
+
+#include "vm.h"
+#include "render_thread.h"
+#include "save_state.h"
+
+
+#define OAM_SCAN_END_DOT 80
+#define TRANSFER_END_DOT 252
+#define LINE_DOTS 456
+#define VBLANK_LINE 144
+#define FRAME_LINES 154
+
+#define LCDC_ENABLED(_L) ((_L) & 0x80)
+#define LCDC_WINDOW_MAP(_L) (((_L) & 0x40) ? 0x9C00 : 0x9800)
+#define LCDC_WINDOW_ENABLED(_L) ((_L) & 0x20)
+#define LCDC_UNSIGNED_TILES(_L) ((_L) & 0x10)
+#define LCDC_BG_MAP(_L) (((_L) & 0x08) ? 0x9C00 : 0x9800)
+#define LCDC_SPRITE_HEIGHT(_L) (((_L) & 0x04) ? 16U : 8U)
+#define LCDC_SPRITES_ENABLED(_L) ((_L) & 0x02)
+#define LCDC_BG_ENABLED(_L) ((_L) & 0x01)
+
+#define STAT_COINCIDENCE 0x04
+#define STAT_HBLANK_INT 0x08
+#define STAT_VBLANK_INT 0x10
+#define STAT_OAM_INT 0x20
+#define STAT_LYC_INT 0x40
+
+#define ATTR_PRIORITY 0x80
+#define ATTR_YFLIP 0x40
+#define ATTR_XFLIP 0x20
+#define ATTR_DMG_PALETTE 0x10
+#define ATTR_BANK 0x08
+#define ATTR_GBC_PALETTE 0x07
+
+#define DMG_BGP 0
+#define DMG_OBP0 1
+#define DMG_OBP1 2
+
+
+static const RGBA DMG_SHADES[PALETTE_COLORS] {
+	{ 0xFF, 0xFF, 0xFF, 0xFF },
+	{ 0xAA, 0xAA, 0xAA, 0xFF },
+	{ 0x55, 0x55, 0x55, 0xFF },
+	{ 0x00, 0x00, 0x00, 0xFF }
+};
+
+
+PPU::PPU(const Bios::Type type, const bool headless) :
+	_gbc{ type == Bios::Type::GameBoyColor },
+	_correction{ ColorCorrection::None },
+	_lcdc{ 0x91 },
+	_stat{ 0 },
+	_scy{ 0 },
+	_scx{ 0 },
+	_ly{ 0 },
+	_lyc{ 0 },
+	_bgp{ 0xFC },
+	_obp0{ 0xFF },
+	_obp1{ 0xFF },
+	_wy{ 0 },
+	_wx{ 0 },
+	_vbk{ 0 },
+	_vram{ 2 * VRAM_BANK_SIZE },
+	_oam{},
+	_bgPalettes{},
+	_objPalettes{},
+	_dmgPalettes{},
+	_sprites{ !_gbc },
+	_tileGeneration{ 0 },
+	_mapGenerations{},
+	_signatures{},
+	_validLines{},
+	_changedLines{},
+	_lastTicks{ 0 },
+	_dot{ 0 },
+	_windowLine{ 0 },
+	_frames{ 0 },
+	_frameBuffer(headless ? 0 : SCREEN_WIDTH * SCREEN_HEIGHT),
+	_sink{ nullptr },
+	_scaler{},
+	_renderThread{ nullptr }
+{
+	setColorCorrection(_gbc ? ColorCorrection::GameBoyColorLCD : ColorCorrection::None);
+	reset();
+}
+PPU::~PPU() {}
+
+void PPU::reset()
+{
+	_lcdc = 0x91;
+	_stat = static_cast<Byte>(Mode::OAMScan);
+	_scy = 0;
+	_scx = 0;
+	_ly = 0;
+	_lyc = 0;
+	_wy = 0;
+	_wx = 0;
+	_vbk = 0;
+
+	resolveDMGPalette(DMG_BGP, _bgp = 0xFC);
+	resolveDMGPalette(DMG_OBP0, _obp0 = 0xFF);
+	resolveDMGPalette(DMG_OBP1, _obp1 = 0xFF);
+
+	_vram.clear();
+	std::fill(std::begin(_oam), std::end(_oam), static_cast<Byte>(0));
+	_sprites.rebuild(_oam, LCDC_SPRITE_HEIGHT(_lcdc));
+
+	_bgPalettes.reset();
+	_objPalettes.reset();
+	invalidateLines();
+
+	_lastTicks = 0;
+	_dot = 0;
+	_windowLine = 0;
+	_frames = 0;
+
+	/* resynchronize the shadow PPU instead of logging the whole reset */
+	if (_renderThread)
+	{
+		_renderThread->stop();
+		_renderThread->start(*this);
+	}
+}
+
+void PPU::step(VirtualMachine& vm)
+{
+	const Ticks now = vm.cpu.ticks();
+	if (!LCDC_ENABLED(_lcdc))
+	{
+		_lastTicks = now;
+		return;
+	}
+
+	while (_lastTicks < now)
+	{
+		const unsigned int boundary = modeEndDot();
+		const Ticks elapsed = min<Ticks>(boundary - _dot, now - _lastTicks);
+		_dot += static_cast<unsigned int>(elapsed);
+		_lastTicks += elapsed;
+		if (_dot < boundary)
+			break;
+
+		switch (mode())
+		{
+			case Mode::OAMScan:
+				setMode(vm, Mode::Transfer);
+				break;
+
+			case Mode::Transfer:
+				if (_renderThread)
+					record(static_cast<u8>(RenderLogEntry::Kind::RenderLine), 0, 0);
+				else renderLine();
+				setMode(vm, Mode::HBlank);
+				break;
+
+			default:
+				nextLine(vm);
+				break;
+		}
+	}
+}
+
+void PPU::schedule(VirtualMachine& vm) const
+{
+	if (LCDC_ENABLED(_lcdc))
+		vm.scheduler.schedule(SchedulerEvent::PPUMode, _lastTicks + (modeEndDot() - _dot));
+	else vm.scheduler.cancel(SchedulerEvent::PPUMode);
+}
+
+void PPU::modeEvent(VirtualMachine& vm)
+{
+	step(vm);
+	schedule(vm);
+}
+
+unsigned int PPU::modeEndDot() const
+{
+	switch (mode())
+	{
+		case Mode::OAMScan: return OAM_SCAN_END_DOT;
+		case Mode::Transfer: return TRANSFER_END_DOT;
+		default: return LINE_DOTS;
+	}
+}
+
+void PPU::setMode(VirtualMachine& vm, const Mode mode)
+{
+	_stat = (_stat & ~0x3) | static_cast<Byte>(mode);
+	switch (mode)
+	{
+		case Mode::HBlank:
+			if (_stat & STAT_HBLANK_INT)
+				vm.ints.request(Interrupt::LCDStat);
+			break;
+
+		case Mode::VBlank:
+			vm.ints.request(Interrupt::VBlank);
+			if (_stat & STAT_VBLANK_INT)
+				vm.ints.request(Interrupt::LCDStat);
+			break;
+
+		case Mode::OAMScan:
+			if (_stat & STAT_OAM_INT)
+				vm.ints.request(Interrupt::LCDStat);
+			break;
+
+		default: break;
+	}
+}
+
+void PPU::nextLine(VirtualMachine& vm)
+{
+	_dot = 0;
+	_ly++;
+
+	if (_ly == VBLANK_LINE)
+	{
+		_frames++;
+		if (_renderThread)
+			record(static_cast<u8>(RenderLogEntry::Kind::FrameEnd), 0, 0);
+		else present();
+		setMode(vm, Mode::VBlank);
+	}
+	else if (_ly >= FRAME_LINES)
+	{
+		_ly = 0;
+		_windowLine = 0;
+		setMode(vm, Mode::OAMScan);
+	}
+	else if (_ly < VBLANK_LINE)
+		setMode(vm, Mode::OAMScan);
+
+	compareLine(vm);
+}
+
+void PPU::compareLine(VirtualMachine& vm)
+{
+	if (_ly == _lyc)
+	{
+		_stat |= STAT_COINCIDENCE;
+		if (_stat & STAT_LYC_INT)
+			vm.ints.request(Interrupt::LCDStat);
+	}
+	else _stat &= ~STAT_COINCIDENCE;
+}
+
+void PPU::setVideoSink(VideoSink* sink)
+{
+	_sink = sink;
+	invalidateLines();
+}
+
+void PPU::setScaler(const Scaler& scaler)
+{
+	_scaler = scaler;
+	invalidateLines();
+}
+
+void PPU::present()
+{
+	if (!_sink || _frameBuffer.empty())
+	{
+		_changedLines.reset();
+		return;
+	}
+
+	/* Scale2x/3x output rows also depend on the source rows above and below */
+	LineMask lines = _changedLines;
+	if (_scaler.filter() != ScaleFilter::Nearest)
+		lines |= (lines << 1) | (lines >> 1);
+
+	size_t pitch;
+	RGBA* dst = _sink->lockFrame(_scaler.outputWidth(SCREEN_WIDTH), _scaler.outputHeight(SCREEN_HEIGHT), pitch);
+	if (dst && _sink->keepsFrame())
+	{
+		for (unsigned int first = 0; first < SCREEN_HEIGHT; first++)
+		{
+			if (!lines[first])
+				continue;
+
+			unsigned int last = first + 1;
+			while (last < SCREEN_HEIGHT && lines[last])
+				last++;
+			_scaler.applyLines(_frameBuffer.data(), SCREEN_WIDTH, SCREEN_HEIGHT, first, last, dst, pitch);
+			first = last;
+		}
+	}
+	else if (dst)
+		_scaler.apply(_frameBuffer.data(), SCREEN_WIDTH, SCREEN_HEIGHT, dst, pitch);
+
+	_sink->unlockFrame(lines);
+	_changedLines.reset();
+}
+
+void PPU::invalidateLines()
+{
+	_validLines.reset();
+	_changedLines.set();
+}
+
+void PPU::setRenderThread(RenderThread* thread)
+{
+	if (_renderThread == thread)
+		return;
+
+	if (_renderThread)
+		_renderThread->stop();
+
+	_renderThread = thread;
+	if (thread)
+		thread->start(*this);
+	else invalidateLines();
+}
+
+void PPU::copyRenderState(const PPU& source)
+{
+	setColorCorrection(source._correction);
+
+	_lcdc = source._lcdc;
+	_stat = source._stat;
+	_scy = source._scy;
+	_scx = source._scx;
+	_ly = source._ly;
+	_lyc = source._lyc;
+	_bgp = source._bgp;
+	_obp0 = source._obp0;
+	_obp1 = source._obp1;
+	_wy = source._wy;
+	_wx = source._wx;
+	_vbk = source._vbk;
+
+	_vram = source._vram;
+	std::copy(std::begin(source._oam), std::end(source._oam), std::begin(_oam));
+	_bgPalettes = source._bgPalettes;
+	_objPalettes = source._objPalettes;
+	std::copy(&source._dmgPalettes[0][0], &source._dmgPalettes[0][0] + DMG_PALETTES * PALETTE_COLORS, &_dmgPalettes[0][0]);
+	_sprites = source._sprites;
+
+	_windowLine = source._windowLine;
+	if (!_frameBuffer.empty() && !source._frameBuffer.empty())
+		std::copy(source._frameBuffer.begin(), source._frameBuffer.end(), _frameBuffer.begin());
+	invalidateLines();
+}
+
+void PPU::record(const u8 kind, const Address addr, const Byte value)
+{
+	_renderThread->record({ static_cast<RenderLogEntry::Kind>(kind), value, addr, _ly });
+}
+
+void PPU::copyState(const PPU& source)
+{
+	copyRenderState(source);
+	_lastTicks = source._lastTicks;
+	_dot = source._dot;
+	_frames = source._frames;
+
+	if (_renderThread)
+	{
+		_renderThread->stop();
+		_renderThread->start(*this);
+	}
+}
+
+void PPU::setColorCorrection(const ColorCorrection correction)
+{
+	if (_renderThread)
+		record(static_cast<u8>(RenderLogEntry::Kind::ColorCorrection), 0, static_cast<Byte>(correction));
+	_correction = correction;
+
+	const RGBA* table = ColorTable::of(correction);
+	_bgPalettes.setColorTable(table);
+	_objPalettes.setColorTable(table);
+}
+ColorCorrection PPU::colorCorrection() const { return _correction; }
+
+void PPU::resolveDMGPalette(const unsigned int index, const Byte value)
+{
+	for (unsigned int i = 0; i < PALETTE_COLORS; i++)
+		_dmgPalettes[index][i] = DMG_SHADES[(value >> (i * 2)) & 0x3];
+}
+
+Byte PPU::readRegister(const Address addr) const
+{
+	switch (addr)
+	{
+		case 0xFF40: return _lcdc;
+		case 0xFF41: return 0x80 | _stat;
+		case 0xFF42: return _scy;
+		case 0xFF43: return _scx;
+		case 0xFF44: return _ly;
+		case 0xFF45: return _lyc;
+		case 0xFF47: return _bgp;
+		case 0xFF48: return _obp0;
+		case 0xFF49: return _obp1;
+		case 0xFF4A: return _wy;
+		case 0xFF4B: return _wx;
+		case 0xFF4F: return _gbc ? 0xFE | _vbk : 0xFF;
+
+		/* GBC palettes */
+		case 0xFF68: return _gbc ? _bgPalettes.readSpecification() : 0xFF;
+		case 0xFF69: return _gbc ? _bgPalettes.readData() : 0xFF;
+		case 0xFF6A: return _gbc ? _objPalettes.readSpecification() : 0xFF;
+		case 0xFF6B: return _gbc ? _objPalettes.readData() : 0xFF;
+
+		default: return 0xFF;
+	}
+}
+
+void PPU::writeRegister(const Address addr, const Byte value)
+{
+	if (_renderThread)
+		record(static_cast<u8>(RenderLogEntry::Kind::Register), addr, value);
+
+	switch (addr)
+	{
+		case 0xFF40:
+			if (LCDC_ENABLED(_lcdc) && !LCDC_ENABLED(value))
+			{
+				_ly = 0;
+				_dot = 0;
+				_windowLine = 0;
+				_stat &= ~0x3;
+			}
+			else if (!LCDC_ENABLED(_lcdc) && LCDC_ENABLED(value))
+				_stat = (_stat & ~0x3) | static_cast<Byte>(Mode::OAMScan);
+			_lcdc = value;
+			_sprites.setHeight(LCDC_SPRITE_HEIGHT(value));
+			break;
+
+		case 0xFF41: _stat = (_stat & 0x07) | (value & 0x78); break;
+		case 0xFF42: _scy = value; break;
+		case 0xFF43: _scx = value; break;
+		case 0xFF44: break;
+		case 0xFF45: _lyc = value; break;
+		case 0xFF47: resolveDMGPalette(DMG_BGP, _bgp = value); break;
+		case 0xFF48: resolveDMGPalette(DMG_OBP0, _obp0 = value); break;
+		case 0xFF49: resolveDMGPalette(DMG_OBP1, _obp1 = value); break;
+		case 0xFF4A: _wy = value; break;
+		case 0xFF4B: _wx = value; break;
+		case 0xFF4F: if (_gbc) _vbk = value & 0x1; break;
+
+		/* GBC palettes */
+		case 0xFF68: if (_gbc) _bgPalettes.writeSpecification(value); break;
+		case 0xFF69: if (_gbc) _bgPalettes.writeData(value); break;
+		case 0xFF6A: if (_gbc) _objPalettes.writeSpecification(value); break;
+		case 0xFF6B: if (_gbc) _objPalettes.writeData(value); break;
+
+		default: break;
+	}
+}
+
+Byte PPU::readVRAM(const Address addr) const { return _vram.read(_vbk * VRAM_BANK_SIZE + (addr & 0x1FFF)); }
+void PPU::writeVRAM(const Address addr, const Byte value)
+{
+	const Address offset = addr & 0x1FFF;
+	if (_vram.read(_vbk * VRAM_BANK_SIZE + offset) == value)
+		return;
+
+	if (_renderThread)
+		record(static_cast<u8>(RenderLogEntry::Kind::VRAM), offset, value);
+
+	_vram.write(_vbk * VRAM_BANK_SIZE + offset, value);
+	if (offset < 0x1800)
+		_tileGeneration++;
+	else _mapGenerations[(offset - 0x1800) / 32]++;
+}
+
+Byte PPU::readOAM(const Address addr) const { return _oam[(addr & 0xFF) % OAM_SIZE]; }
+void PPU::writeOAM(const Address addr, const Byte value)
+{
+	const Address offset = (addr & 0xFF) % OAM_SIZE;
+	if (_renderThread)
+		record(static_cast<u8>(RenderLogEntry::Kind::OAM), offset, value);
+	_oam[offset] = value;
+	_sprites.update(offset, value);
+}
+
+void PPU::dma(const Byte* data)
+{
+	if (_renderThread)
+	{
+		for (Address i = 0; i < OAM_SIZE; i++)
+			record(static_cast<u8>(RenderLogEntry::Kind::DMA), i, data[i]);
+		record(static_cast<u8>(RenderLogEntry::Kind::DMAEnd), 0, 0);
+	}
+
+	std::copy(data, data + OAM_SIZE, _oam);
+	_sprites.rebuild(_oam, LCDC_SPRITE_HEIGHT(_lcdc));
+}
+
+
+
+
+#define MAP_ROW(_Base, _Y) ((((_Base) & 0x0400) >> 5) + ((_Y) & 0xFF) / 8)
+
+void PPU::renderLine()
+{
+	Byte colorIds[SCREEN_WIDTH];
+	Byte priorities[SCREEN_WIDTH];
+
+	const bool tiles = _gbc || LCDC_BG_ENABLED(_lcdc);
+	const unsigned int bgY = (_scy + _ly) & 0xFF;
+	const unsigned int windowLine = _windowLine;
+	unsigned int windowX = SCREEN_WIDTH;
+	if (tiles && LCDC_WINDOW_ENABLED(_lcdc) && _wy <= _ly && _wx < SCREEN_WIDTH + 7)
+	{
+		windowX = _wx < 7 ? 0 : _wx - 7U;
+		_windowLine++;
+	}
+
+	/* headless: the window line counter is all that has to be kept */
+	if (_frameBuffer.empty())
+		return;
+	RGBA* out = _frameBuffer.data() + _ly * SCREEN_WIDTH;
+
+	const LineSignature signature {
+		_lcdc, _scx, _scy,
+		static_cast<Byte>(windowX < SCREEN_WIDTH ? _wx : 0xFF),
+		static_cast<Byte>(windowX < SCREEN_WIDTH ? windowLine : 0xFF),
+		_mapGenerations[MAP_ROW(LCDC_BG_MAP(_lcdc), bgY)],
+		windowX < SCREEN_WIDTH ? _mapGenerations[MAP_ROW(LCDC_WINDOW_MAP(_lcdc), windowLine)] : 0,
+		_tileGeneration,
+		_sprites.generation(_ly),
+		_gbc ? _bgPalettes.generation() : _bgp,
+		_gbc ? _objPalettes.generation() : static_cast<u32>(_obp0 | (_obp1 << 8))
+	};
+	if (_validLines[_ly] && _signatures[_ly] == signature)
+		return;
+
+	_signatures[_ly] = signature;
+	_validLines.set(_ly);
+	_changedLines.set(_ly);
+
+	/* DMG: LCDC.0 turns BG and window off. GBC: it only removes their priority */
+	if (tiles)
+	{
+		renderTiles(0, windowX, LCDC_BG_MAP(_lcdc), _scx, bgY, colorIds, priorities);
+		if (windowX < SCREEN_WIDTH)
+			renderTiles(windowX, SCREEN_WIDTH, LCDC_WINDOW_MAP(_lcdc), 0, windowLine, colorIds, priorities);
+
+		if (_gbc && !LCDC_BG_ENABLED(_lcdc))
+			std::fill(std::begin(colorIds), std::end(colorIds), static_cast<Byte>(0));
+	}
+	else
+	{
+		std::fill(out, out + SCREEN_WIDTH, _dmgPalettes[DMG_BGP][0]);
+		std::fill(std::begin(colorIds), std::end(colorIds), static_cast<Byte>(0));
+		std::fill(std::begin(priorities), std::end(priorities), static_cast<Byte>(0));
+	}
+
+	if (LCDC_SPRITES_ENABLED(_lcdc))
+		renderSprites(colorIds, priorities);
+}
+
+void PPU::renderTiles(const unsigned int from, const unsigned int to, const Address mapBase,
+	unsigned int mapX, const unsigned int mapY, Byte* colorIds, Byte* priorities)
+{
+	const Address mapRow = (mapBase & 0x1FFF) + (mapY / 8) * 32;
+	const Byte* map = _vram.at(mapRow);
+	const Byte* attributes = _vram.at(VRAM_BANK_SIZE + mapRow);
+	const bool unsignedTiles = LCDC_UNSIGNED_TILES(_lcdc);
+	RGBA* out = _frameBuffer.data() + _ly * SCREEN_WIDTH;
+
+	for (unsigned int x = from; x < to; x++, mapX++)
+	{
+		const unsigned int column = (mapX / 8) & 0x1F;
+		const Byte tile = map[column];
+		const Byte attr = _gbc ? attributes[column] : 0;
+
+		const unsigned int row = (attr & ATTR_YFLIP) ? 7 - (mapY & 7) : (mapY & 7);
+		const unsigned int base = unsignedTiles ? tile * 16U : static_cast<unsigned int>(0x1000 + static_cast<s8>(tile) * 16);
+		const Byte* data = _vram.at(((attr & ATTR_BANK) ? VRAM_BANK_SIZE : 0) + base + row * 2);
+
+		const unsigned int bit = (attr & ATTR_XFLIP) ? (mapX & 7) : 7 - (mapX & 7);
+		const Byte id = ((data[0] >> bit) & 0x1) | (((data[1] >> bit) & 0x1) << 1);
+
+		colorIds[x] = id;
+		priorities[x] = attr & ATTR_PRIORITY;
+		out[x] = _gbc ? _bgPalettes.palette(attr & ATTR_GBC_PALETTE)[id] : _dmgPalettes[DMG_BGP][id];
+	}
+}
+
+void PPU::renderSprites(const Byte* colorIds, const Byte* priorities)
+{
+	unsigned int count;
+	const Byte* sprites = _sprites.line(_ly, count);
+	const unsigned int height = LCDC_SPRITE_HEIGHT(_lcdc);
+	RGBA* out = _frameBuffer.data() + _ly * SCREEN_WIDTH;
+	bool drawn[SCREEN_WIDTH] = {};
+
+	for (unsigned int i = 0; i < count; i++)
+	{
+		const Byte* sprite = _oam + sprites[i] * 4;
+		const int left = static_cast<int>(sprite[1]) - 8;
+		if (left <= -8 || left >= SCREEN_WIDTH)
+			continue;
+
+		const Byte attr = sprite[3];
+		unsigned int row = _ly - (sprite[0] - 16U);
+		if (attr & ATTR_YFLIP)
+			row = height - 1 - row;
+
+		const Byte tile = height == 16 ? (sprite[2] & 0xFE) : sprite[2];
+		const Byte* data = _vram.at(((_gbc && (attr & ATTR_BANK)) ? VRAM_BANK_SIZE : 0) + tile * 16U + row * 2);
+		const RGBA* palette = _gbc
+			? _objPalettes.palette(attr & ATTR_GBC_PALETTE)
+			: _dmgPalettes[(attr & ATTR_DMG_PALETTE) ? DMG_OBP1 : DMG_OBP0];
+
+		for (unsigned int px = 0; px < 8; px++)
+		{
+			const int x = left + static_cast<int>(px);
+			if (x < 0 || x >= SCREEN_WIDTH || drawn[x])
+				continue;
+
+			const unsigned int bit = (attr & ATTR_XFLIP) ? px : 7 - px;
+			const Byte id = ((data[0] >> bit) & 0x1) | (((data[1] >> bit) & 0x1) << 1);
+			if (!id)
+				continue;
+
+			/* the first opaque sprite pixel owns the dot, even when hidden behind BG */
+			drawn[x] = true;
+			if (colorIds[x] && ((attr & ATTR_PRIORITY) || priorities[x]))
+				continue;
+
+			out[x] = palette[id];
+		}
+	}
+}
+
+void PPU::saveState(StateWriter& state) const
+{
+	state.begin(STATE_SECTION('P', 'P', 'U', ' '));
+	state.write(_lcdc);
+	state.write(_stat);
+	state.write(_scy);
+	state.write(_scx);
+	state.write(_ly);
+	state.write(_lyc);
+	state.write(_bgp);
+	state.write(_obp0);
+	state.write(_obp1);
+	state.write(_wy);
+	state.write(_wx);
+	state.write(_vbk);
+	_bgPalettes.saveState(state);
+	_objPalettes.saveState(state);
+	state.write(_lastTicks);
+	state.write(_dot);
+	state.write(_windowLine);
+	state.write(_frames);
+	state.end();
+
+	_vram.saveState(state, STATE_SECTION('V', 'R', 'A', 'M'));
+	state.region(STATE_SECTION('O', 'A', 'M', ' '), _oam, sizeof(_oam));
+}
+
+void PPU::loadState(StateReader& state)
+{
+	state.begin(STATE_SECTION('P', 'P', 'U', ' '));
+	state.read(_lcdc);
+	state.read(_stat);
+	state.read(_scy);
+	state.read(_scx);
+	state.read(_ly);
+	state.read(_lyc);
+	state.read(_bgp);
+	state.read(_obp0);
+	state.read(_obp1);
+	state.read(_wy);
+	state.read(_wx);
+	state.read(_vbk);
+	_bgPalettes.loadState(state);
+	_objPalettes.loadState(state);
+	state.read(_lastTicks);
+	state.read(_dot);
+	state.read(_windowLine);
+	state.read(_frames);
+
+	/* _ly and _dot index per line tables: reject a state that puts them out of range */
+	if (_ly >= FRAME_LINES || _dot > LINE_DOTS)
+	{
+		state.fail();
+		_ly = 0;
+		_dot = 0;
+	}
+
+	_vram.loadState(state, STATE_SECTION('V', 'R', 'A', 'M'));
+	if (const Byte* oam = state.region(STATE_SECTION('O', 'A', 'M', ' '), sizeof(_oam)))
+		std::memcpy(_oam, oam, sizeof(_oam));
+
+	/* everything derived is rebuilt; the frame buffer is not part of the state */
+	resolveDMGPalette(DMG_BGP, _bgp);
+	resolveDMGPalette(DMG_OBP0, _obp0);
+	resolveDMGPalette(DMG_OBP1, _obp1);
+	_sprites.rebuild(_oam, LCDC_SPRITE_HEIGHT(_lcdc));
+	_tileGeneration++;
+	for (u32& generation : _mapGenerations)
+		generation++;
+	invalidateLines();
+
+	if (_renderThread)
+	{
+		_renderThread->stop();
+		_renderThread->start(*this);
+	}
+}
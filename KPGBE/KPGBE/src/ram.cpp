@@ -1,25 +1,176 @@
 #include "ram.h"
 
+#include "save_state.h"
+
+#include <cstring>
+#include <vector>
+
 RAM::RAM(const size_t size) :
-	_mem{ new Byte[size] },
-	_size{ size }
-{}
+	_pages{ nullptr },
+	_writable{ nullptr },
+	_size{ size },
+	_count{ (size + RAM_PAGE_MASK) >> RAM_PAGE_SHIFT }
+{
+	_pages = new Page*[_count];
+	_writable = new Byte*[_count];
+	for (size_t i = 0; i < _count; i++)
+	{
+		_pages[i] = zeroPage();
+		_pages[i]->refs.fetch_add(1, std::memory_order_relaxed);
+		_writable[i] = nullptr;
+	}
+}
+RAM::RAM(const RAM& ram) :
+	_pages{ new Page*[ram._count] },
+	_writable{ new Byte*[ram._count] },
+	_size{ ram._size },
+	_count{ ram._count }
+{
+	for (size_t i = 0; i < _count; i++)
+	{
+		_pages[i] = ram._pages[i];
+		_pages[i]->refs.fetch_add(1, std::memory_order_relaxed);
+		_writable[i] = ram._writable[i] = nullptr;
+	}
+}
 RAM::~RAM()
 {
-	delete[] _mem;
+	release();
+	delete[] _pages;
+	delete[] _writable;
+}
+
+RAM& RAM::operator= (const RAM& ram)
+{
+	if (this == &ram)
+		return *this;
+
+	release();
+	if (_count != ram._count)
+	{
+		delete[] _pages;
+		delete[] _writable;
+		_pages = new Page*[ram._count];
+		_writable = new Byte*[ram._count];
+	}
+	_size = ram._size;
+	_count = ram._count;
+
+	for (size_t i = 0; i < _count; i++)
+	{
+		_pages[i] = ram._pages[i];
+		_pages[i]->refs.fetch_add(1, std::memory_order_relaxed);
+		_writable[i] = ram._writable[i] = nullptr;
+	}
+	return *this;
 }
 
 size_t RAM::size() const { return _size; }
 
-void RAM::dump(std::ostream& os, const size_t bytesPerRow) { DumpBytesToStream(os, _mem, _size, bytesPerRow); }
+void RAM::dump(std::ostream& os, const size_t bytesPerRow)
+{
+	std::vector<Byte> bytes(_size);
+	for (size_t i = 0; i < _size; i++)
+		bytes[i] = read(static_cast<Address>(i));
+	DumpBytesToStream(os, bytes.data(), _size, bytesPerRow);
+}
+
+void RAM::assign(const Byte* data)
+{
+	for (size_t i = 0; i < _count; i++)
+	{
+		Byte* page = _writable[i];
+		if (!page)
+			page = own(i, false);
+		std::memcpy(page, data + i * RAM_PAGE_SIZE, pageSize(i));
+	}
+}
+
+void RAM::clear()
+{
+	release();
+	for (size_t i = 0; i < _count; i++)
+	{
+		_pages[i] = zeroPage();
+		_pages[i]->refs.fetch_add(1, std::memory_order_relaxed);
+		_writable[i] = nullptr;
+	}
+}
+
+void RAM::saveState(StateWriter& state, const u32 id) const
+{
+	state.begin(id);
+	for (size_t i = 0; i < _count; i++)
+		state.write(page(i), pageSize(i));
+	state.end();
+}
+
+void RAM::loadState(StateReader& state, const u32 id)
+{
+	if (const Byte* data = state.region(id, _size))
+		assign(data);
+}
+
+size_t RAM::sharedPages() const
+{
+	size_t shared = 0;
+	for (size_t i = 0; i < _count; i++)
+		if (_pages[i]->refs.load(std::memory_order_relaxed) > 1)
+			shared++;
+	return shared;
+}
+
+bool RAM::equals(const RAM& ram) const
+{
+	if (_size != ram._size)
+		return false;
 
-void RAM::write(const Address addr, const Byte value) { _mem[addr % _size] = value; }
-Byte RAM::read(const Address addr) const { return _mem[addr % _size]; }
+	for (size_t i = 0; i < _count; i++)
+		if (_pages[i] != ram._pages[i] && std::memcmp(_pages[i]->data, ram._pages[i]->data, pageSize(i)) != 0)
+			return false;
+	return true;
+}
+
+Byte* RAM::own(const size_t index, const bool keep)
+{
+	Page* page = _pages[index];
+	if (page->refs.load(std::memory_order_acquire) != 1)
+	{
+		Page* copy = new Page;
+		copy->refs.store(1, std::memory_order_relaxed);
+		if (keep)
+			std::memcpy(copy->data, page->data, RAM_PAGE_SIZE);
+
+		/* the other references may have gone away in the meantime */
+		if (page->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			delete page;
+		_pages[index] = page = copy;
+	}
+	return _writable[index] = page->data;
+}
 
-Byte& RAM::operator[] (const Address& addr) { return _mem[addr % _size]; }
-const Byte& RAM::operator[] (const Address& addr) const { return _mem[addr % _size]; }
+void RAM::release()
+{
+	for (size_t i = 0; i < _count; i++)
+		if (_pages[i]->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			delete _pages[i];
+}
+
+RAM::Page* RAM::zeroPage()
+{
+	/* starts with a reference nobody releases, so it is never written nor freed */
+	static Page* const page = [] {
+		Page* zero = new Page{};
+		zero->refs.store(1, std::memory_order_relaxed);
+		return zero;
+	}();
+	return page;
+}
 
 std::ostream& operator<< (std::ostream& os, const RAM& ram)
 {
-	return DumpBytesToStream(os, ram._mem, ram._size);
+	std::vector<Byte> bytes(ram._size);
+	for (size_t i = 0; i < ram._size; i++)
+		bytes[i] = ram.read(static_cast<Address>(i));
+	return DumpBytesToStream(os, bytes.data(), ram._size);
 }
@@ -0,0 +1,39 @@
+#include "rate_control.h"
+
+
+RateControl::RateControl() :
+	_maxDeviation{ RATE_CONTROL_MAX_DEVIATION },
+	_targetFrames{ 0 },
+	_fill{ -1 },
+	_drift{ 0 },
+	_ratio{ 1 },
+	_updates{ 0 }
+{}
+
+void RateControl::reset()
+{
+	_fill = -1;
+	_drift = 0;
+	_ratio = 1;
+	_updates = 0;
+}
+
+void RateControl::setMaxDeviation(const f64 deviation) { _maxDeviation = ::clamp(deviation, 0.0, 0.05); }
+
+f64 RateControl::update(const size_t bufferedFrames, const size_t capacityFrames)
+{
+	if (capacityFrames == 0)
+		return _ratio = 1;
+
+	/* averaging hides the sawtooth of the consumer taking whole chunks */
+	const f64 fill = static_cast<f64>(bufferedFrames);
+	_fill = _fill < 0 ? fill : _fill + (fill - _fill) * RATE_CONTROL_SMOOTHING;
+
+	const f64 target = static_cast<f64>(max<size_t>(_targetFrames ? min(_targetFrames, capacityFrames) : capacityFrames / 2, 1));
+	const f64 error = ::clamp((_fill - target) / target, -1.0, 1.0);
+
+	_drift = ::clamp(_drift + error * RATE_CONTROL_INTEGRAL, -1.0, 1.0);
+
+	_updates++;
+	return _ratio = 1.0 - _maxDeviation * ::clamp(error + _drift, -1.0, 1.0);
+}
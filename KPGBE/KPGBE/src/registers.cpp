@@ -1,4 +1,5 @@
 #include "registers.h"
+#include "save_state.h"
 
 
 Registers::Registers() :
@@ -43,3 +44,26 @@ std::ostream& operator<< (std::ostream& os, const Registers& regs)
 }
 #undef STR_R8
 #undef STR_R16
+
+void Registers::saveState(StateWriter& state) const
+{
+	state.begin(STATE_SECTION('R', 'E', 'G', 'S'));
+	state.write(AF);
+	state.write(BC);
+	state.write(DE);
+	state.write(HL);
+	state.write(SP);
+	state.write(PC);
+	state.end();
+}
+
+void Registers::loadState(StateReader& state)
+{
+	state.begin(STATE_SECTION('R', 'E', 'G', 'S'));
+	state.read(AF);
+	state.read(BC);
+	state.read(DE);
+	state.read(HL);
+	state.read(SP);
+	state.read(PC);
+}
@@ -0,0 +1,108 @@
+#include "render_thread.h"
+
+#include <chrono>
+
+
+RenderThread::RenderThread(const Bios::Type type, const size_t capacity) :
+	_ppu{ type },
+	_log{ capacity },
+	_thread{},
+	_running{ false },
+	_frames{ 0 },
+	_recorded{ 0 },
+	_replayed{ 0 }
+{}
+RenderThread::~RenderThread() { stop(); }
+
+void RenderThread::start(const PPU& source)
+{
+	stop();
+
+	_ppu.copyRenderState(source);
+	_running.store(true, std::memory_order_release);
+	_thread = std::thread{ &RenderThread::run, this };
+}
+
+void RenderThread::stop()
+{
+	if (!_thread.joinable())
+		return;
+
+	_running.store(false, std::memory_order_release);
+	_thread.join();
+}
+
+bool RenderThread::isRunning() const { return _running.load(std::memory_order_acquire); }
+
+void RenderThread::flush() const
+{
+	while (_replayed.load(std::memory_order_acquire) != _recorded)
+		std::this_thread::yield();
+}
+
+void RenderThread::run()
+{
+	RenderLogEntry entry;
+	unsigned int idle = 0;
+	for (;;)
+	{
+		if (_log.pop(entry))
+		{
+			replay(entry);
+			_replayed.fetch_add(1, std::memory_order_release);
+			idle = 0;
+		}
+		else if (!_running.load(std::memory_order_acquire))
+		{
+			/* the producer may have pushed between the failed pop and the stop request */
+			if (_log.empty())
+				break;
+		}
+		else if (++idle < RENDER_IDLE_SPINS)
+			std::this_thread::yield();
+		else std::this_thread::sleep_for(std::chrono::microseconds{ RENDER_IDLE_SLEEP_MICROS });
+	}
+}
+
+void RenderThread::replay(const RenderLogEntry& entry)
+{
+	switch (entry.kind)
+	{
+		case RenderLogEntry::Kind::Register:
+			_ppu.writeRegister(entry.address, entry.value);
+			break;
+
+		case RenderLogEntry::Kind::VRAM:
+			_ppu.writeVRAM(entry.address, entry.value);
+			break;
+
+		case RenderLogEntry::Kind::OAM:
+			_ppu.writeOAM(entry.address, entry.value);
+			break;
+
+		/* raw OAM bytes; the sprite index is rebuilt once on DMAEnd */
+		case RenderLogEntry::Kind::DMA:
+			_ppu._oam[entry.address % OAM_SIZE] = entry.value;
+			break;
+
+		case RenderLogEntry::Kind::DMAEnd:
+			_ppu._sprites.rebuild(_ppu._oam, _ppu._sprites.height());
+			break;
+
+		case RenderLogEntry::Kind::ColorCorrection:
+			_ppu.setColorCorrection(static_cast<ColorCorrection>(entry.value));
+			break;
+
+		case RenderLogEntry::Kind::RenderLine:
+			_ppu._ly = entry.line;
+			_ppu.renderLine();
+			break;
+
+		case RenderLogEntry::Kind::FrameEnd:
+			_ppu._frames++;
+			_ppu._windowLine = 0;
+			_ppu.present();
+			_frames.fetch_add(1, std::memory_order_release);
+			break;
+	}
+}
@@ -0,0 +1,324 @@
+#include "resampler.h"
+
+#include <cmath>
+#include <cstring>
+
+/* SSE2 is part of x64; the AVX kernel is compiled for that function only and picked
+ * at startup when the CPU and the OS support it, so one binary runs everywhere */
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RESAMPLER_SSE
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#define RESAMPLER_AVX
+#define RESAMPLER_AVX_TARGET
+#include <intrin.h>
+#elif defined(__GNUC__)
+#define RESAMPLER_AVX
+#define RESAMPLER_AVX_TARGET __attribute__((target("avx")))
+#endif
+#endif
+
+
+struct ResamplerPreset
+{
+	unsigned int taps;
+	f64 cutoff;
+};
+
+/* taps must be a multiple of 8 (one AVX register) */
+static const ResamplerPreset PRESETS[] {
+	{ 8, 0.80 },
+	{ 16, 0.88 },
+	{ 32, 0.94 }
+};
+
+static inline unsigned int gcd(unsigned int a, unsigned int b)
+{
+	while (b)
+	{
+		const unsigned int t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+typedef f32 (*DotKernel)(const f32* a, const f32* b, const unsigned int count);
+
+#if defined(RESAMPLER_SSE)
+static f32 DotSSE(const f32* a, const f32* b, const unsigned int count)
+{
+	__m128 sum0 = _mm_setzero_ps();
+	__m128 sum1 = _mm_setzero_ps();
+	for (unsigned int i = 0; i < count; i += 8)
+	{
+		sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+		sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+	}
+	__m128 sum = _mm_add_ps(sum0, sum1);
+	sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+	sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 0x1));
+	return _mm_cvtss_f32(sum);
+}
+#else
+static f32 DotScalar(const f32* a, const f32* b, const unsigned int count)
+{
+	f32 sum = 0;
+	for (unsigned int i = 0; i < count; i++)
+		sum += a[i] * b[i];
+	return sum;
+}
+#endif
+
+#if defined(RESAMPLER_AVX)
+RESAMPLER_AVX_TARGET static f32 DotAVX(const f32* a, const f32* b, const unsigned int count)
+{
+	__m256 sum = _mm256_setzero_ps();
+	for (unsigned int i = 0; i < count; i += 8)
+		sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+	__m128 half = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+	half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+	half = _mm_add_ss(half, _mm_shuffle_ps(half, half, 0x1));
+	return _mm_cvtss_f32(half);
+}
+
+static bool CPUHasAVX()
+{
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 1);
+	/* AVX and OSXSAVE, then the OS must save the YMM registers as well */
+	if ((info[2] & (1 << 28)) == 0 || (info[2] & (1 << 27)) == 0)
+		return false;
+	return (_xgetbv(0) & 0x6) == 0x6;
+#else
+	return __builtin_cpu_supports("avx");
+#endif
+}
+#endif
+
+static DotKernel SelectDot()
+{
+#if defined(RESAMPLER_AVX)
+	if (CPUHasAVX())
+		return DotAVX;
+#endif
+#if defined(RESAMPLER_SSE)
+	return DotSSE;
+#else
+	return DotScalar;
+#endif
+}
+
+static const DotKernel Dot = SelectDot();
+
+static inline s16 ToSample(const f32 value)
+{
+	return static_cast<s16>(::clamp(std::lround(value), -0x8000L, 0x7FFFL));
+}
+
+
+Resampler::Resampler() :
+	_inputRate{ 0 },
+	_outputRate{ 0 },
+	_channels{ 2 },
+	_quality{ ResamplerQuality::Balanced },
+	_taps{ 0 },
+	_phases{ 1 },
+	_denominator{ 1 },
+	_step{ 1 },
+	_coefs{},
+	_history{},
+	_historySize{ 0 },
+	_position{ 0 },
+	_phase{ 0 }
+{}
+
+bool Resampler::configure(const unsigned int inputRate, const unsigned int outputRate, const unsigned int channels, const ResamplerQuality quality)
+{
+	CHECK_MSG(inputRate > 0 && outputRate > 0, "invalid sample rates %u -> %u.\n", inputRate, outputRate);
+	CHECK_MSG(channels == 1 || channels == 2, "invalid channel count %u.\n", channels);
+
+	_inputRate = inputRate;
+	_outputRate = outputRate;
+	_channels = channels;
+	_quality = quality;
+
+	{
+		const unsigned int divisor = gcd(inputRate, outputRate);
+		_denominator = outputRate / divisor;
+		_step = inputRate / divisor;
+		_phases = min<unsigned int>(_denominator, RESAMPLER_MAX_PHASES);
+	}
+
+	buildFilter();
+	reset();
+	return OK;
+
+	ON_ERROR_RETURN;
+}
+
+void Resampler::reset()
+{
+	/* half a window of silence so the first output is centered on the first input */
+	for (std::vector<f32>& history : _history)
+		history.assign(_taps + RESAMPLER_BLOCK, 0.0f);
+	_historySize = _taps / 2;
+	_position = 0;
+	_phase = 0;
+}
+
+void Resampler::buildFilter()
+{
+	const ResamplerPreset& preset = PRESETS[static_cast<unsigned int>(_quality)];
+	const f64 pi = 3.14159265358979323846;
+	const f64 cutoff = preset.cutoff * min(1.0, static_cast<f64>(_denominator) / _step);
+	const f64 half = preset.taps / 2.0;
+
+	_taps = preset.taps;
+	_coefs.assign(static_cast<size_t>(_phases) * _taps, 0.0f);
+	for (unsigned int phase = 0; phase < _phases; phase++)
+	{
+		f32* row = &_coefs[static_cast<size_t>(phase) * _taps];
+		f64 sum = 0;
+		for (unsigned int k = 0; k < _taps; k++)
+		{
+			const f64 t = static_cast<f64>(k) - (half - 1) - static_cast<f64>(phase) / _phases;
+			const f64 x = pi * cutoff * t;
+			const f64 sinc = t == 0 ? 1.0 : std::sin(x) / x;
+			const f64 w = (t + half) / _taps;
+			const f64 window = w <= 0 || w >= 1 ? 0.0 : 0.42 - 0.5 * std::cos(2 * pi * w) + 0.08 * std::cos(4 * pi * w);
+			row[k] = static_cast<f32>(sinc * window);
+			sum += row[k];
+		}
+
+		for (unsigned int k = 0; k < _taps; k++)
+			row[k] = static_cast<f32>(row[k] / sum);
+	}
+}
+
+size_t Resampler::process(const s16* in, const size_t frames, s16* out)
+{
+	size_t written = 0;
+	for (size_t done = 0; done < frames; done += RESAMPLER_BLOCK)
+	{
+		const size_t block = min<size_t>(RESAMPLER_BLOCK, frames - done);
+		written += processBlock(in + done * 2, block, out + written * _channels);
+	}
+	return written;
+}
+
+size_t Resampler::processBlock(const s16* in, const size_t frames, s16* out)
+{
+	f32* left = _history[0].data();
+	f32* right = _history[1].data();
+	if (_channels == 1)
+	{
+		for (size_t i = 0; i < frames; i++)
+			left[_historySize + i] = (in[i * 2] + in[i * 2 + 1]) * 0.5f;
+	}
+	else
+	{
+		for (size_t i = 0; i < frames; i++)
+		{
+			left[_historySize + i] = in[i * 2];
+			right[_historySize + i] = in[i * 2 + 1];
+		}
+	}
+	_historySize += frames;
+
+	size_t written = 0;
+	while (_position + _taps <= _historySize)
+	{
+		const size_t row = static_cast<size_t>(static_cast<u64>(_phase) * _phases / _denominator);
+		const f32* coefs = &_coefs[row * _taps];
+		if (_channels == 1)
+			out[written] = ToSample(Dot(left + _position, coefs, _taps));
+		else
+		{
+			out[written * 2] = ToSample(Dot(left + _position, coefs, _taps));
+			out[written * 2 + 1] = ToSample(Dot(right + _position, coefs, _taps));
+		}
+		written++;
+
+		_phase += _step;
+		_position += _phase / _denominator;
+		_phase %= _denominator;
+	}
+
+	/* keep only what the next window still needs */
+	const size_t consumed = min(_position, _historySize);
+	const size_t remaining = _historySize - consumed;
+	std::memmove(left, left + consumed, remaining * sizeof(f32));
+	if (_channels == 2)
+		std::memmove(right, right + consumed, remaining * sizeof(f32));
+	_historySize = remaining;
+	_position -= consumed;
+	return written;
+}
+
+
+
+
+ResamplingSink::ResamplingSink(AudioSink& target, const unsigned int inputRate, const ResamplerQuality quality) :
+	_target{ target },
+	_resampler{},
+	_inputRate{ inputRate },
+	_valid{ false },
+	_staging{},
+	_output{}
+{
+	CHECK_MSG(SUCCESS(_resampler.configure(inputRate, target.sampleRate(), target.channels(), quality)),
+		"unable to resample audio for the sink, its samples are dropped.\n");
+
+	_output.resize(_resampler.maxOutputFrames(RESAMPLER_BLOCK) * _resampler.channels());
+	_valid = true;
+	return;
+
+__error:
+	_valid = false;
+}
+
+unsigned int ResamplingSink::sampleRate() const { return _inputRate; }
+
+s16* ResamplingSink::lockSamples(size_t& frames)
+{
+	frames = min<size_t>(frames, RESAMPLER_BLOCK);
+	return _staging;
+}
+
+void ResamplingSink::unlockSamples(const size_t frames)
+{
+	if (!_valid)
+		return;
+
+	const unsigned int channels = _resampler.channels();
+	const size_t produced = _resampler.process(_staging, frames, _output.data());
+
+	size_t written = 0;
+	while (written < produced)
+	{
+		size_t count = produced - written;
+		s16* out = _target.lockSamples(count);
+		if (count == 0)
+			break;
+
+		std::memcpy(out, _output.data() + written * channels, count * channels * sizeof(s16));
+		_target.unlockSamples(count);
+		written += count;
+	}
+}
+
+size_t ResamplingSink::bufferedFrames() const
+{
+	if (!_valid)
+		return 0;
+	return static_cast<size_t>(static_cast<u64>(_target.bufferedFrames()) * _resampler.inputRate() / _resampler.outputRate());
+}
+
+size_t ResamplingSink::capacityFrames() const
+{
+	if (!_valid)
+		return 0;
+	return static_cast<size_t>(static_cast<u64>(_target.capacityFrames()) * _resampler.inputRate() / _resampler.outputRate());
+}
@@ -0,0 +1,230 @@
+#include "rewind.h"
+#include "vm.h"
+
+#include <cstring>
+
+#define ENTRY_OVERHEAD (2 * sizeof(u32))
+
+/* a literal run only ends at a run of equal bytes at least this long */
+#define MIN_ZERO_RUN 8
+
+
+static inline void writeVarint(std::vector<Byte>& out, size_t value)
+{
+	while (value >= 0x80)
+	{
+		out.push_back(static_cast<Byte>(value | 0x80));
+		value >>= 7;
+	}
+	out.push_back(static_cast<Byte>(value));
+}
+
+static inline size_t readVarint(const Byte*& data, const Byte* end)
+{
+	size_t value = 0;
+	for (unsigned int shift = 0; data < end; shift += 7)
+	{
+		const Byte byte = *(data++);
+		value |= static_cast<size_t>(byte & 0x7F) << shift;
+		if (!(byte & 0x80))
+			break;
+	}
+	return value;
+}
+
+static inline size_t equalRun(const Byte* a, const Byte* b, const size_t from, const size_t size)
+{
+	size_t i = from;
+	for (; i + sizeof(u64) <= size; i += sizeof(u64))
+	{
+		u64 x, y;
+		std::memcpy(&x, a + i, sizeof(u64));
+		std::memcpy(&y, b + i, sizeof(u64));
+		if (x != y)
+			break;
+	}
+	while (i < size && a[i] == b[i])
+		++i;
+	return i - from;
+}
+
+
+
+Rewind::Rewind(const size_t capacity, const unsigned int interval) :
+	_ring(capacity),
+	_head{ 0 },
+	_tail{ 0 },
+	_used{ 0 },
+	_count{ 0 },
+	_interval{ interval > 0 ? interval : 1 },
+	_frames{ 0 },
+	_capture{},
+	_latest{},
+	_delta{}
+{}
+
+void Rewind::capture(const VirtualMachine& vm)
+{
+	if (++_frames < _interval)
+		return;
+	_frames = 0;
+
+	vm.saveState(_capture);
+
+	if (_latest.size() != _capture.size())
+	{
+		/* first snapshot, or a different machine: nothing to take a delta against */
+		clear();
+		_latest.assign(_capture.data(), _capture.data() + _capture.size());
+		return;
+	}
+
+	encode(_capture.data());
+	push(_delta.data(), _delta.size());
+	std::memcpy(_latest.data(), _capture.data(), _latest.size());
+}
+
+bool Rewind::rewind(VirtualMachine& vm)
+{
+	if (_latest.empty())
+		return false;
+
+	if (!vm.loadState(_latest.data(), _latest.size()))
+	{
+		clear();
+		return false;
+	}
+
+	if (!pop())
+		_latest.clear();
+	_frames = 0;
+	return true;
+}
+
+void Rewind::clear()
+{
+	_head = _tail = _used = _count = 0;
+	_frames = 0;
+	_latest.clear();
+}
+
+void Rewind::setInterval(const unsigned int interval)
+{
+	_interval = interval > 0 ? interval : 1;
+	_frames = 0;
+}
+
+void Rewind::push(const Byte* data, const size_t size)
+{
+	const size_t total = size + ENTRY_OVERHEAD;
+	if (total > _ring.size())
+	{
+		/* the history before this snapshot can no longer be rebuilt */
+		_head = _tail = _used = _count = 0;
+		return;
+	}
+
+	while (_ring.size() - _used < total)
+		dropOldest();
+
+	const u32 header = static_cast<u32>(size);
+	copyIn(_head, reinterpret_cast<const Byte*>(&header), sizeof(u32));
+	copyIn(_head + sizeof(u32), data, size);
+	copyIn(_head + sizeof(u32) + size, reinterpret_cast<const Byte*>(&header), sizeof(u32));
+
+	_head = (_head + total) % _ring.size();
+	_used += total;
+	++_count;
+}
+
+bool Rewind::pop()
+{
+	if (_count == 0)
+		return false;
+
+	u32 size;
+	copyOut(_head + _ring.size() - sizeof(u32), reinterpret_cast<Byte*>(&size), sizeof(u32));
+
+	const size_t total = size + ENTRY_OVERHEAD;
+	_head = (_head + _ring.size() - total) % _ring.size();
+	_used -= total;
+	--_count;
+
+	_delta.resize(size);
+	copyOut(_head + sizeof(u32), _delta.data(), size);
+	decode(_delta.data(), size);
+	return true;
+}
+
+void Rewind::dropOldest()
+{
+	u32 size;
+	copyOut(_tail, reinterpret_cast<Byte*>(&size), sizeof(u32));
+
+	const size_t total = size + ENTRY_OVERHEAD;
+	_tail = (_tail + total) % _ring.size();
+	_used -= total;
+	--_count;
+}
+
+void Rewind::copyIn(size_t position, const Byte* data, const size_t size)
+{
+	position %= _ring.size();
+	const size_t first = min(size, _ring.size() - position);
+	std::memcpy(_ring.data() + position, data, first);
+	std::memcpy(_ring.data(), data + first, size - first);
+}
+
+void Rewind::copyOut(size_t position, Byte* data, const size_t size) const
+{
+	position %= _ring.size();
+	const size_t first = min(size, _ring.size() - position);
+	std::memcpy(data, _ring.data() + position, first);
+	std::memcpy(data + first, _ring.data(), size - first);
+}
+
+/* Delta of the current state against _latest: pairs of (equal bytes, literal count)
+ * varints, each followed by that many XORed bytes */
+void Rewind::encode(const Byte* current)
+{
+	const Byte* previous = _latest.data();
+	const size_t size = _latest.size();
+
+	_delta.clear();
+	size_t i = 0;
+	while (i < size)
+	{
+		const size_t zeros = equalRun(previous, current, i, size);
+		i += zeros;
+
+		size_t end = i;
+		while (end < size)
+		{
+			const size_t run = equalRun(previous, current, end, size);
+			if (run >= MIN_ZERO_RUN || end + run >= size)
+				break;
+			end += run + 1;
+		}
+
+		writeVarint(_delta, zeros);
+		writeVarint(_delta, end - i);
+		for (; i < end; ++i)
+			_delta.push_back(previous[i] ^ current[i]);
+	}
+}
+
+void Rewind::decode(const Byte* data, const size_t size)
+{
+	const Byte* end = data + size;
+	Byte* state = _latest.data();
+	const size_t stateSize = _latest.size();
+
+	size_t i = 0;
+	while (data < end && i < stateSize)
+	{
+		i += readVarint(data, end);
+		const size_t literals = min(readVarint(data, end), static_cast<size_t>(end - data));
+		for (size_t j = 0; j < literals && i < stateSize; ++j, ++i)
+			state[i] ^= *(data++);
+	}
+}
@@ -0,0 +1,123 @@
+#include "run_ahead.h"
+
+#include "vm.h"
+
+#include <chrono>
+
+
+static inline f64 ElapsedMicros(const std::chrono::steady_clock::time_point from, const std::chrono::steady_clock::time_point to)
+{
+	return std::chrono::duration<f64, std::micro>(to - from).count();
+}
+
+
+
+RunAhead::RunAhead(const unsigned int frames, const bool secondInstance) :
+	_frames{ frames },
+	_secondInstance{ secondInstance },
+	_state{},
+	_apu{},
+	_joypad{},
+	_ahead{},
+	_stats{}
+{}
+RunAhead::~RunAhead() {}
+
+RunStatus RunAhead::runFrame(VirtualMachine& vm)
+{
+	if (_frames == 0)
+		return vm.runFrame();
+
+	VideoSink* video = vm.ppu.videoSink();
+	vm.ppu.setVideoSink(nullptr);
+
+	const RunStatus status = _secondInstance ? runSecond(vm, video) : runSingle(vm, video);
+
+	vm.ppu.setVideoSink(video);
+	return status;
+}
+
+/* Hidden frames run with no sinks, the last one with the video only */
+RunStatus RunAhead::runSingle(VirtualMachine& vm, VideoSink* video)
+{
+	const RunStatus status = vm.runFrame();
+	if (status != RunStatus::FrameComplete)
+		return status;
+
+	/* a state leaves out the samples not delivered yet and the input queue */
+	const auto saveStart = std::chrono::steady_clock::now();
+	vm.saveState(_state);
+	_apu = vm.apu;
+	_joypad = vm.joypad;
+	const auto saveEnd = std::chrono::steady_clock::now();
+
+	vm.apu.setAudioSink(nullptr);
+	for (unsigned int i = 1; i < _frames; i++)
+		vm.runFrame();
+	vm.ppu.setVideoSink(video);
+	vm.runFrame();
+	vm.ppu.setVideoSink(nullptr);
+
+	const auto loadStart = std::chrono::steady_clock::now();
+	vm.loadState(_state);
+	vm.apu = _apu;
+	vm.joypad = _joypad;
+	vm.joypad.schedule(vm);
+	const auto loadEnd = std::chrono::steady_clock::now();
+
+	measure(ElapsedMicros(saveStart, saveEnd), ElapsedMicros(loadStart, loadEnd));
+	return status;
+}
+
+RunStatus RunAhead::runSecond(VirtualMachine& vm, VideoSink* video)
+{
+	const RunStatus status = vm.runFrame();
+	if (status != RunStatus::FrameComplete)
+		return status;
+
+	if (!_ahead || _ahead->mmu.bios().isGBC() != vm.mmu.bios().isGBC())
+	{
+		_ahead = vm.clone(false);
+		_ahead->ppu.setScaler(vm.ppu.scaler());
+	}
+
+	const auto saveStart = std::chrono::steady_clock::now();
+	vm.saveState(_state);
+	const auto saveEnd = std::chrono::steady_clock::now();
+	_ahead->loadState(_state);
+	const auto loadEnd = std::chrono::steady_clock::now();
+
+	_ahead->joypad = vm.joypad;
+	_ahead->joypad.schedule(*_ahead);
+
+	for (unsigned int i = 1; i < _frames; i++)
+		_ahead->runFrame();
+	_ahead->ppu.setVideoSink(video);
+	_ahead->runFrame();
+	_ahead->ppu.setVideoSink(nullptr);
+
+	measure(ElapsedMicros(saveStart, saveEnd), ElapsedMicros(saveEnd, loadEnd));
+	return status;
+}
+
+void RunAhead::setFrames(const unsigned int frames) { _frames = frames; }
+
+void RunAhead::setSecondInstance(const bool enabled)
+{
+	_secondInstance = enabled;
+	if (!enabled)
+		_ahead.reset();
+}
+
+void RunAhead::resetStats() { _stats = RunAheadStats{}; }
+
+void RunAhead::measure(const f64 save, const f64 load)
+{
+	_stats.frames++;
+	_stats.saveMicros = save;
+	_stats.loadMicros = load;
+	_stats.maxSaveMicros = max(_stats.maxSaveMicros, save);
+	_stats.maxLoadMicros = max(_stats.maxLoadMicros, load);
+	_stats.totalSaveMicros += save;
+	_stats.totalLoadMicros += load;
+}
@@ -0,0 +1,164 @@
+#include "save_state.h"
+
+#include <fstream>
+
+#define TABLE_OFFSET sizeof(SaveStateHeader)
+#define SECTIONS_OFFSET (TABLE_OFFSET + SAVE_STATE_MAX_SECTIONS * sizeof(SaveStateSection))
+
+
+SaveState::SaveState() :
+	_data{}
+{}
+
+bool SaveState::read(const char* filename)
+{
+	FileData file;
+	CHECK(SUCCESS(file.read(filename)));
+	assign(file.data, file.size);
+	return OK;
+
+	ON_ERROR_RETURN;
+}
+
+bool SaveState::write(const char* filename) const
+{
+	std::fstream f{ filename, std::fstream::out | std::fstream::binary };
+	CHECK_MSG(f, "unable to open file \"%s\".\n", filename);
+	CHECK_MSG(!_data.empty(), "empty save state.\n");
+
+	f.write(reinterpret_cast<const char*>(_data.data()), _data.size());
+	CHECK_MSG(!f.fail(), "write file failed.\n");
+
+	f.close();
+	return OK;
+
+	ON_ERROR_CLOSE_STREAM_AND_RETURN(f);
+}
+
+void SaveState::assign(const Byte* data, const size_t size) { _data.assign(data, data + size); }
+void SaveState::clear() { _data.clear(); }
+
+
+
+StateWriter::StateWriter(SaveState& state, const u8 machine) :
+	_data{ state._data },
+	_section{ 0 }
+{
+	/* keeps the capacity, so saving again into the same state does not allocate */
+	_data.assign(SECTIONS_OFFSET, 0);
+
+	SaveStateHeader header{};
+	header.magic = SAVE_STATE_MAGIC;
+	header.version = SAVE_STATE_VERSION;
+	header.machine = machine;
+	header.size = static_cast<u32>(SECTIONS_OFFSET);
+	std::memcpy(_data.data(), &header, sizeof(header));
+}
+
+void StateWriter::begin(const u32 id)
+{
+	if (_section >= SAVE_STATE_MAX_SECTIONS)
+		UNREACHABLE("too many save state sections.\n");
+
+	_data.resize(align_up<size_t>(_data.size(), SAVE_STATE_ALIGNMENT), 0);
+
+	SaveStateSection& entry = section(static_cast<unsigned int>(_section));
+	entry.id = id;
+	entry.offset = static_cast<u32>(_data.size());
+	entry.size = 0;
+}
+
+void StateWriter::end()
+{
+	SaveStateSection& entry = section(static_cast<unsigned int>(_section));
+	entry.size = static_cast<u32>(_data.size() - entry.offset);
+	_section++;
+
+	SaveStateHeader& header = *reinterpret_cast<SaveStateHeader*>(_data.data());
+	header.sections = static_cast<u8>(_section);
+	header.size = static_cast<u32>(_data.size());
+}
+
+SaveStateSection& StateWriter::section(const unsigned int index)
+{
+	return reinterpret_cast<SaveStateSection*>(_data.data() + TABLE_OFFSET)[index];
+}
+
+
+
+StateReader::StateReader(const Byte* data, const size_t size) :
+	_data{ data },
+	_size{ size },
+	_sections{ 0 },
+	_next{ 0 },
+	_cursor{ nullptr },
+	_end{ nullptr },
+	_ok{ false }
+{}
+
+bool StateReader::open(const u8 machine)
+{
+	SaveStateHeader header;
+
+	_ok = false;
+	CHECK_MSG(_data && _size >= SECTIONS_OFFSET, "save state too short.\n");
+
+	std::memcpy(&header, _data, sizeof(header));
+	CHECK_MSG(header.magic == SAVE_STATE_MAGIC, "not a save state.\n");
+	CHECK_MSG(header.version == SAVE_STATE_VERSION, "unsupported save state version %u.\n", static_cast<unsigned int>(header.version));
+	CHECK_MSG(header.machine == machine, "save state of a different machine type.\n");
+	CHECK_MSG(header.size <= _size && header.sections <= SAVE_STATE_MAX_SECTIONS, "corrupt save state header.\n");
+
+	_sections = header.sections;
+	for (unsigned int i = 0; i < _sections; i++)
+	{
+		const SaveStateSection& entry = section(i);
+		CHECK_MSG(entry.offset >= SECTIONS_OFFSET && entry.offset <= header.size && entry.size <= header.size - entry.offset,
+			"corrupt save state section table.\n");
+	}
+
+	_next = 0;
+	_ok = true;
+	return OK;
+
+	ON_ERROR_RETURN;
+}
+
+bool StateReader::begin(const u32 id)
+{
+	/* sections are read in the order they were written: the next one is almost always it */
+	for (unsigned int n = 0; n < _sections; n++)
+	{
+		const unsigned int index = (_next + n) % _sections;
+		const SaveStateSection& entry = section(index);
+		if (entry.id == id)
+		{
+			_cursor = _data + entry.offset;
+			_end = _cursor + entry.size;
+			_next = index + 1;
+			return true;
+		}
+	}
+
+	_cursor = _end = nullptr;
+	_ok = false;
+	return false;
+}
+
+const Byte* StateReader::region(const u32 id, const size_t size)
+{
+	if (!begin(id) || static_cast<size_t>(_end - _cursor) != size)
+	{
+		_ok = false;
+		return nullptr;
+	}
+
+	const Byte* data = _cursor;
+	_cursor = _end;
+	return data;
+}
+
+const SaveStateSection& StateReader::section(const unsigned int index) const
+{
+	return reinterpret_cast<const SaveStateSection*>(_data + TABLE_OFFSET)[index];
+}
@@ -0,0 +1,322 @@
+#include "scaler.h"
+
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SCALER_SSE2
+#include <emmintrin.h>
+#endif
+
+
+typedef u32 Pixel;
+
+static_assert(sizeof(RGBA) == sizeof(Pixel), "RGBA must be a packed 32 bit pixel");
+
+#define PIXELS(_Ptr) reinterpret_cast<const Pixel*>(_Ptr)
+#define OUT_PIXELS(_Ptr) reinterpret_cast<Pixel*>(_Ptr)
+
+/* Rounded per channel average, same result as _mm_avg_epu8 */
+static inline Pixel blend(const Pixel a, const Pixel b) { return (a | b) - (((a ^ b) & 0xFEFEFEFEU) >> 1); }
+
+struct Neighbors
+{
+	const Pixel* above;
+	const Pixel* center;
+	const Pixel* below;
+};
+
+static inline Neighbors neighbors(const RGBA* src, const unsigned int width, const unsigned int height, const unsigned int y)
+{
+	return {
+		PIXELS(src) + (y > 0 ? y - 1 : 0) * width,
+		PIXELS(src) + y * width,
+		PIXELS(src) + (y + 1 < height ? y + 1 : y) * width
+	};
+}
+
+
+#ifdef SCALER_SSE2
+#define LOAD(_Ptr) _mm_loadu_si128(reinterpret_cast<const __m128i*>(_Ptr))
+#define STORE(_Ptr, _V) _mm_storeu_si128(reinterpret_cast<__m128i*>(_Ptr), (_V))
+#define EQ(_A, _B) _mm_cmpeq_epi32((_A), (_B))
+#define NE(_A, _B) _mm_xor_si128(_mm_cmpeq_epi32((_A), (_B)), ones)
+#define AND(_A, _B) _mm_and_si128((_A), (_B))
+#define OR(_A, _B) _mm_or_si128((_A), (_B))
+#define SELECT(_Mask, _Then, _Else) _mm_or_si128(_mm_and_si128((_Mask), (_Then)), _mm_andnot_si128((_Mask), (_Else)))
+#endif
+
+
+
+/* Nearest */
+static void NearestLines(const RGBA* src, const unsigned int width, const unsigned int first, const unsigned int last,
+	const unsigned int factor, RGBA* dst, const size_t dstPitch)
+{
+	for (unsigned int y = first; y < last; y++)
+	{
+		const Pixel* in = PIXELS(src) + y * width;
+		Pixel* out = OUT_PIXELS(dst) + y * factor * dstPitch;
+		unsigned int x = 0;
+
+		if (factor == 1)
+		{
+			std::memcpy(out, in, width * sizeof(Pixel));
+			continue;
+		}
+
+#ifdef SCALER_SSE2
+		if (factor == 2)
+		{
+			for (; x + 4 <= width; x += 4)
+			{
+				const __m128i p = LOAD(in + x);
+				STORE(out + x * 2, _mm_unpacklo_epi32(p, p));
+				STORE(out + x * 2 + 4, _mm_unpackhi_epi32(p, p));
+			}
+		}
+		else if (factor == 4)
+		{
+			for (; x < width; x++)
+				STORE(out + x * 4, _mm_set1_epi32(static_cast<int>(in[x])));
+		}
+#endif
+		for (; x < width; x++)
+		{
+			for (unsigned int i = 0; i < factor; i++)
+				out[x * factor + i] = in[x];
+		}
+
+		for (unsigned int i = 1; i < factor; i++)
+			std::memcpy(out + i * dstPitch, out, width * factor * sizeof(Pixel));
+	}
+}
+
+
+
+/* Scale2x / EdgeBlend2x
+ *   B      E0 E1
+ * D E F -> E2 E3
+ *   H
+ */
+template<bool _Blend>
+static inline void Scale2xPixel(const Pixel b, const Pixel d, const Pixel e, const Pixel f, const Pixel h, Pixel* out0, Pixel* out1)
+{
+	if (b != h && d != f)
+	{
+		out0[0] = d == b ? (_Blend ? blend(e, d) : d) : e;
+		out0[1] = b == f ? (_Blend ? blend(e, f) : f) : e;
+		out1[0] = d == h ? (_Blend ? blend(e, d) : d) : e;
+		out1[1] = h == f ? (_Blend ? blend(e, f) : f) : e;
+	}
+	else
+	{
+		out0[0] = out0[1] = e;
+		out1[0] = out1[1] = e;
+	}
+}
+
+template<bool _Blend>
+static void Scale2xLines(const RGBA* src, const unsigned int width, const unsigned int height,
+	const unsigned int first, const unsigned int last, RGBA* dst, const size_t dstPitch)
+{
+	for (unsigned int y = first; y < last; y++)
+	{
+		const Neighbors n = neighbors(src, width, height, y);
+		Pixel* out0 = OUT_PIXELS(dst) + y * 2 * dstPitch;
+		Pixel* out1 = out0 + dstPitch;
+
+		Scale2xPixel<_Blend>(n.above[0], n.center[0], n.center[0], n.center[min(1U, width - 1)], n.below[0], out0, out1);
+		unsigned int x = 1;
+
+#ifdef SCALER_SSE2
+		const __m128i ones = _mm_set1_epi32(-1);
+		for (; x + 4 < width; x += 4)
+		{
+			const __m128i b = LOAD(n.above + x);
+			const __m128i d = LOAD(n.center + x - 1);
+			const __m128i e = LOAD(n.center + x);
+			const __m128i f = LOAD(n.center + x + 1);
+			const __m128i h = LOAD(n.below + x);
+
+			const __m128i active = AND(NE(b, h), NE(d, f));
+			__m128i dv = d, fv = f;
+			if (_Blend)
+			{
+				dv = _mm_avg_epu8(e, d);
+				fv = _mm_avg_epu8(e, f);
+			}
+
+			const __m128i e0 = SELECT(AND(active, EQ(d, b)), dv, e);
+			const __m128i e1 = SELECT(AND(active, EQ(b, f)), fv, e);
+			const __m128i e2 = SELECT(AND(active, EQ(d, h)), dv, e);
+			const __m128i e3 = SELECT(AND(active, EQ(h, f)), fv, e);
+
+			STORE(out0 + x * 2, _mm_unpacklo_epi32(e0, e1));
+			STORE(out0 + x * 2 + 4, _mm_unpackhi_epi32(e0, e1));
+			STORE(out1 + x * 2, _mm_unpacklo_epi32(e2, e3));
+			STORE(out1 + x * 2 + 4, _mm_unpackhi_epi32(e2, e3));
+		}
+#endif
+		for (; x < width; x++)
+		{
+			Scale2xPixel<_Blend>(n.above[x], n.center[x - 1], n.center[x], n.center[min(x + 1, width - 1)], n.below[x],
+				out0 + x * 2, out1 + x * 2);
+		}
+	}
+}
+
+
+
+/* Scale3x
+ * A B C      E0 E1 E2
+ * D E F  ->  E3 E4 E5
+ * G H I      E6 E7 E8
+ */
+static inline void Scale3xPixel(const Pixel a, const Pixel b, const Pixel c, const Pixel d, const Pixel e, const Pixel f,
+	const Pixel g, const Pixel h, const Pixel i, Pixel* out0, Pixel* out1, Pixel* out2)
+{
+	if (b != h && d != f)
+	{
+		out0[0] = d == b ? d : e;
+		out0[1] = (d == b && e != c) || (b == f && e != a) ? b : e;
+		out0[2] = b == f ? f : e;
+		out1[0] = (d == b && e != g) || (d == h && e != a) ? d : e;
+		out1[1] = e;
+		out1[2] = (b == f && e != i) || (h == f && e != c) ? f : e;
+		out2[0] = d == h ? d : e;
+		out2[1] = (d == h && e != i) || (h == f && e != g) ? h : e;
+		out2[2] = h == f ? f : e;
+	}
+	else
+	{
+		out0[0] = out0[1] = out0[2] = e;
+		out1[0] = out1[1] = out1[2] = e;
+		out2[0] = out2[1] = out2[2] = e;
+	}
+}
+
+static void Scale3xLines(const RGBA* src, const unsigned int width, const unsigned int height,
+	const unsigned int first, const unsigned int last, RGBA* dst, const size_t dstPitch)
+{
+	for (unsigned int y = first; y < last; y++)
+	{
+		const Neighbors n = neighbors(src, width, height, y);
+		Pixel* out0 = OUT_PIXELS(dst) + y * 3 * dstPitch;
+		Pixel* out1 = out0 + dstPitch;
+		Pixel* out2 = out1 + dstPitch;
+
+		const unsigned int r = min(1U, width - 1);
+		Scale3xPixel(n.above[0], n.above[0], n.above[r], n.center[0], n.center[0], n.center[r],
+			n.below[0], n.below[0], n.below[r], out0, out1, out2);
+		unsigned int x = 1;
+
+#ifdef SCALER_SSE2
+		const __m128i ones = _mm_set1_epi32(-1);
+		alignas(16) Pixel rows[9][4];
+		for (; x + 4 < width; x += 4)
+		{
+			const __m128i a = LOAD(n.above + x - 1);
+			const __m128i b = LOAD(n.above + x);
+			const __m128i c = LOAD(n.above + x + 1);
+			const __m128i d = LOAD(n.center + x - 1);
+			const __m128i e = LOAD(n.center + x);
+			const __m128i f = LOAD(n.center + x + 1);
+			const __m128i g = LOAD(n.below + x - 1);
+			const __m128i h = LOAD(n.below + x);
+			const __m128i i = LOAD(n.below + x + 1);
+
+			const __m128i active = AND(NE(b, h), NE(d, f));
+			const __m128i db = AND(active, EQ(d, b));
+			const __m128i bf = AND(active, EQ(b, f));
+			const __m128i dh = AND(active, EQ(d, h));
+			const __m128i hf = AND(active, EQ(h, f));
+
+			STORE(rows[0], SELECT(db, d, e));
+			STORE(rows[1], SELECT(OR(AND(db, NE(e, c)), AND(bf, NE(e, a))), b, e));
+			STORE(rows[2], SELECT(bf, f, e));
+			STORE(rows[3], SELECT(OR(AND(db, NE(e, g)), AND(dh, NE(e, a))), d, e));
+			STORE(rows[4], e);
+			STORE(rows[5], SELECT(OR(AND(bf, NE(e, i)), AND(hf, NE(e, c))), f, e));
+			STORE(rows[6], SELECT(dh, d, e));
+			STORE(rows[7], SELECT(OR(AND(dh, NE(e, i)), AND(hf, NE(e, g))), h, e));
+			STORE(rows[8], SELECT(hf, f, e));
+
+			for (unsigned int p = 0; p < 4; p++)
+			{
+				Pixel* o = out0 + (x + p) * 3;
+				o[0] = rows[0][p]; o[1] = rows[1][p]; o[2] = rows[2][p];
+				o = out1 + (x + p) * 3;
+				o[0] = rows[3][p]; o[1] = rows[4][p]; o[2] = rows[5][p];
+				o = out2 + (x + p) * 3;
+				o[0] = rows[6][p]; o[1] = rows[7][p]; o[2] = rows[8][p];
+			}
+		}
+#endif
+		for (; x < width; x++)
+		{
+			const unsigned int l = x - 1, rx = min(x + 1, width - 1);
+			Scale3xPixel(n.above[l], n.above[x], n.above[rx], n.center[l], n.center[x], n.center[rx],
+				n.below[l], n.below[x], n.below[rx], out0 + x * 3, out1 + x * 3, out2 + x * 3);
+		}
+	}
+}
+
+
+
+
+Scaler::Scaler() :
+	_filter{ ScaleFilter::Nearest },
+	_factor{ 1 }
+{}
+
+bool Scaler::setFilter(const ScaleFilter filter, const unsigned int factor)
+{
+	switch (filter)
+	{
+		case ScaleFilter::Nearest:
+			CHECK_MSG(factor >= 1 && factor <= MAX_SCALE_FACTOR, "invalid scale factor %u.\n", factor);
+			_factor = factor;
+			break;
+
+		case ScaleFilter::Scale2x:
+		case ScaleFilter::EdgeBlend2x:
+			_factor = 2;
+			break;
+
+		case ScaleFilter::Scale3x:
+			_factor = 3;
+			break;
+	}
+
+	_filter = filter;
+	return OK;
+
+	ON_ERROR_RETURN;
+}
+
+void Scaler::apply(const RGBA* src, const unsigned int width, const unsigned int height, RGBA* dst, const size_t dstPitch) const
+{
+	applyLines(src, width, height, 0, height, dst, dstPitch);
+}
+
+void Scaler::applyLines(const RGBA* src, const unsigned int width, const unsigned int height,
+	const unsigned int first, const unsigned int last, RGBA* dst, const size_t dstPitch) const
+{
+	switch (_filter)
+	{
+		case ScaleFilter::Nearest:
+			NearestLines(src, width, first, last, _factor, dst, dstPitch);
+			break;
+
+		case ScaleFilter::Scale2x:
+			Scale2xLines<false>(src, width, height, first, last, dst, dstPitch);
+			break;
+
+		case ScaleFilter::Scale3x:
+			Scale3xLines(src, width, height, first, last, dst, dstPitch);
+			break;
+
+		case ScaleFilter::EdgeBlend2x:
+			Scale2xLines<true>(src, width, height, first, last, dst, dstPitch);
+			break;
+	}
+}
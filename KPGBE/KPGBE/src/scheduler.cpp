@@ -0,0 +1,103 @@
+#include "scheduler.h"
+
+#include "vm.h"
+#include "save_state.h"
+
+#include <algorithm>
+
+
+Scheduler::Scheduler() :
+	_deadlines{},
+	_next{ INVALID_TICKS },
+	_nextEvent{ 0 }
+{
+	reset();
+}
+
+void Scheduler::reset()
+{
+	std::fill(std::begin(_deadlines), std::end(_deadlines), INVALID_TICKS);
+	updateNext();
+}
+
+void Scheduler::schedule(const SchedulerEvent event, const Ticks when)
+{
+	_deadlines[static_cast<unsigned int>(event)] = when;
+	updateNext();
+}
+
+void Scheduler::cancel(const SchedulerEvent event)
+{
+	_deadlines[static_cast<unsigned int>(event)] = INVALID_TICKS;
+	updateNext();
+}
+
+void Scheduler::dispatch(VirtualMachine& vm, const Ticks now)
+{
+	while (_next <= now)
+	{
+		const Ticks when = _next;
+		const SchedulerEvent event = static_cast<SchedulerEvent>(_nextEvent);
+		_deadlines[_nextEvent] = INVALID_TICKS;
+		updateNext();
+		fire(vm, event, when);
+	}
+}
+
+void Scheduler::updateNext()
+{
+	_nextEvent = 0;
+	for (unsigned int event = 1; event < SCHEDULER_EVENTS; event++)
+	{
+		if (_deadlines[event] < _deadlines[_nextEvent])
+			_nextEvent = event;
+	}
+	_next = _deadlines[_nextEvent];
+}
+
+void Scheduler::fire(VirtualMachine& vm, const SchedulerEvent event, const Ticks when)
+{
+	switch (event)
+	{
+		case SchedulerEvent::FrameSequencer:
+			vm.apu.sequencerEvent(vm, when);
+			break;
+
+		case SchedulerEvent::TimerOverflow:
+			vm.timer.overflowEvent(vm, when);
+			break;
+
+		case SchedulerEvent::PPUMode:
+			vm.ppu.modeEvent(vm);
+			break;
+
+		case SchedulerEvent::SerialTransfer:
+			vm.serial.transferEvent(vm, when);
+			break;
+
+		case SchedulerEvent::JoypadInput:
+			vm.joypad.inputEvent(vm, when);
+			break;
+
+		default: break;
+	}
+}
+
+void Scheduler::saveState(StateWriter& state) const
+{
+	/* the joypad deadline follows the frontend's queue, which a state leaves out */
+	Ticks deadlines[SCHEDULER_EVENTS];
+	std::copy(std::begin(_deadlines), std::end(_deadlines), deadlines);
+	deadlines[static_cast<unsigned int>(SchedulerEvent::JoypadInput)] = INVALID_TICKS;
+
+	state.begin(STATE_SECTION('S', 'C', 'H', 'D'));
+	state.write(deadlines);
+	state.end();
+}
+
+void Scheduler::loadState(StateReader& state)
+{
+	state.begin(STATE_SECTION('S', 'C', 'H', 'D'));
+	state.read(_deadlines);
+	updateNext();
+}
@@ -0,0 +1,162 @@
+#include "serial.h"
+
+#include "vm.h"
+#include "link_cable.h"
+#include "save_state.h"
+
+
+#define SB_REGISTER 0xFF01
+#define SC_REGISTER 0xFF02
+
+/* 8192 Hz, or 262144 Hz with the GBC fast clock, in CPU cycles per bit */
+#define BIT_CYCLES 512
+#define FAST_BIT_CYCLES 16
+#define TRANSFER_BITS 8
+
+/* How often a connected port reports its clock to the cable */
+#define LINK_SYNC_TICKS 512
+
+
+Serial::Serial(const Bios::Type type) :
+	_gbc{ type == Bios::Type::GameBoyColor },
+	_sb{ 0 },
+	_sc{ 0 },
+	_transferEnd{ INVALID_TICKS },
+	_cable{ nullptr },
+	_side{ 0 }
+{}
+
+void Serial::reset()
+{
+	if (_cable)
+		_cable->cancel(_side);
+
+	_sb = 0;
+	_sc = 0;
+	_transferEnd = INVALID_TICKS;
+}
+
+Byte Serial::readRegister(const Address addr) const
+{
+	switch (addr)
+	{
+		case SB_REGISTER: return _sb;
+		case SC_REGISTER: return (_gbc ? 0x7C : 0x7E) | _sc;
+		default: return 0xFF;
+	}
+}
+
+void Serial::writeRegister(VirtualMachine& vm, const Address addr, const Byte value)
+{
+	if (addr == SB_REGISTER)
+	{
+		_sb = value;
+
+		/* a listening port answers with the current SB */
+		Byte received;
+		if (_cable && isTransferring() && !internalClock() && _cable->listen(_side, _sb, vm.cpu.ticks(), received))
+			complete(vm, received);
+		return;
+	}
+	if (addr != SC_REGISTER)
+		return;
+
+	const Ticks now = vm.cpu.ticks();
+	_sc = value & (_gbc ? 0x83 : 0x81);
+	_transferEnd = INVALID_TICKS;
+	if (_cable)
+		_cable->cancel(_side);
+
+	if (isTransferring())
+	{
+		if (internalClock())
+		{
+			const Ticks bitCycles = _gbc && (_sc & 0x2) ? FAST_BIT_CYCLES : BIT_CYCLES;
+			_transferEnd = vm.cpu.cyclesToTicks(vm.cpu.cycles() + bitCycles * TRANSFER_BITS);
+			if (_cable)
+				_cable->send(_side, _sb, now, _transferEnd);
+		}
+		else if (_cable)
+		{
+			Byte received;
+			if (_cable->listen(_side, _sb, now, received))
+				complete(vm, received);
+		}
+	}
+
+	schedule(vm);
+}
+
+void Serial::schedule(VirtualMachine& vm)
+{
+	Ticks next = _transferEnd;
+	if (_cable)
+		next = min(next, vm.cpu.ticks() + LINK_SYNC_TICKS);
+
+	if (next != INVALID_TICKS)
+		vm.scheduler.schedule(SchedulerEvent::SerialTransfer, next);
+	else vm.scheduler.cancel(SchedulerEvent::SerialTransfer);
+}
+
+void Serial::transferEvent(VirtualMachine& vm, const Ticks when)
+{
+	const Ticks now = vm.cpu.ticks();
+	if (_transferEnd != INVALID_TICKS && when >= _transferEnd)
+	{
+		const Ticks end = _transferEnd;
+		_transferEnd = INVALID_TICKS;
+		complete(vm, _cable ? _cable->receive(_side, max(now, end)) : 0xFF);
+	}
+	else if (_cable)
+	{
+		/* listening also reports the clock, in the same step */
+		Byte received;
+		if (!isTransferring() || internalClock())
+			_cable->publish(_side, now);
+		else if (_cable->listen(_side, _sb, now, received))
+			complete(vm, received);
+	}
+
+	schedule(vm);
+}
+
+void Serial::complete(VirtualMachine& vm, const Byte received)
+{
+	_sb = received;
+	_sc &= 0x7F;
+	vm.ints.request(Interrupt::Serial);
+}
+
+void Serial::saveState(StateWriter& state) const
+{
+	state.begin(STATE_SECTION('S', 'E', 'R', 'L'));
+	state.write(_sb);
+	state.write(_sc);
+	state.write(_transferEnd);
+	state.end();
+}
+
+void Serial::loadState(StateReader& state, const Ticks now)
+{
+	/* whatever was on the cable belongs to the state being replaced, and so does the clock */
+	if (_cable)
+	{
+		_cable->cancel(_side);
+		_cable->resync(_side, now);
+	}
+
+	state.begin(STATE_SECTION('S', 'E', 'R', 'L'));
+	state.read(_sb);
+	state.read(_sc);
+	state.read(_transferEnd);
+}
+
+void Serial::copyState(const Serial& source)
+{
+	if (_cable)
+		_cable->cancel(_side);
+
+	_sb = source._sb;
+	_sc = source._sc;
+	_transferEnd = source._transferEnd;
+}
@@ -0,0 +1,153 @@
+#include "sprites.h"
+
+
+#define FIRST_LINE(_Y) (static_cast<int>(_Y) - 16)
+
+
+SpriteIndex::SpriteIndex(const bool xPriority) :
+	_xPriority{ xPriority },
+	_height{ 8 },
+	_y{},
+	_x{},
+	_coverage{},
+	_selected{},
+	_count{},
+	_dirty{},
+	_generations{}
+{}
+
+void SpriteIndex::rebuild(const Byte* oam, const unsigned int height)
+{
+	_height = height;
+	std::fill(std::begin(_coverage), std::end(_coverage), 0ULL);
+	std::fill(std::begin(_dirty), std::end(_dirty), true);
+	for (u32& generation : _generations)
+		generation++;
+
+	for (unsigned int sprite = 0; sprite < OAM_SPRITES; sprite++)
+	{
+		_y[sprite] = oam[sprite * 4];
+		_x[sprite] = oam[sprite * 4 + 1];
+		insert(sprite);
+	}
+}
+
+void SpriteIndex::update(const Address offset, const Byte value)
+{
+	const unsigned int sprite = (offset / 4) % OAM_SPRITES;
+	switch (offset & 0x3)
+	{
+		case 0:
+			if (_y[sprite] != value)
+			{
+				remove(sprite);
+				_y[sprite] = value;
+				insert(sprite);
+			}
+			break;
+
+		case 1:
+			if (_x[sprite] != value)
+			{
+				_x[sprite] = value;
+
+				/* X only reorders the selection where it sets the priority; it always moves pixels */
+				if (_xPriority)
+					invalidate(sprite);
+				else touch(sprite);
+			}
+			break;
+
+		/* tile and attributes do not change the selection */
+		default:
+			touch(sprite);
+			break;
+	}
+}
+
+void SpriteIndex::setHeight(const unsigned int height)
+{
+	if (_height == height)
+		return;
+
+	for (unsigned int sprite = 0; sprite < OAM_SPRITES; sprite++)
+		remove(sprite);
+	_height = height;
+	for (unsigned int sprite = 0; sprite < OAM_SPRITES; sprite++)
+		insert(sprite);
+}
+
+void SpriteIndex::insert(const unsigned int sprite)
+{
+	const int first = FIRST_LINE(_y[sprite]);
+	const int last = min(first + static_cast<int>(_height), SPRITE_LINES);
+	const u64 bit = 0x1ULL << sprite;
+	for (int ly = max(first, 0); ly < last; ly++)
+	{
+		_coverage[ly] |= bit;
+		_dirty[ly] = true;
+		_generations[ly]++;
+	}
+}
+
+void SpriteIndex::remove(const unsigned int sprite)
+{
+	const int first = FIRST_LINE(_y[sprite]);
+	const int last = min(first + static_cast<int>(_height), SPRITE_LINES);
+	const u64 mask = ~(0x1ULL << sprite);
+	for (int ly = max(first, 0); ly < last; ly++)
+	{
+		_coverage[ly] &= mask;
+		_dirty[ly] = true;
+		_generations[ly]++;
+	}
+}
+
+void SpriteIndex::invalidate(const unsigned int sprite)
+{
+	const int first = FIRST_LINE(_y[sprite]);
+	const int last = min(first + static_cast<int>(_height), SPRITE_LINES);
+	for (int ly = max(first, 0); ly < last; ly++)
+	{
+		_dirty[ly] = true;
+		_generations[ly]++;
+	}
+}
+
+void SpriteIndex::touch(const unsigned int sprite)
+{
+	const int first = FIRST_LINE(_y[sprite]);
+	const int last = min(first + static_cast<int>(_height), SPRITE_LINES);
+	for (int ly = max(first, 0); ly < last; ly++)
+		_generations[ly]++;
+}
+
+void SpriteIndex::select(const unsigned int ly)
+{
+	u64 coverage = _coverage[ly];
+	Byte* selected = _selected[ly];
+	unsigned int count = 0;
+
+	/* hardware picks the first 10 sprites in OAM order */
+	for (unsigned int sprite = 0; coverage && count < SPRITES_PER_LINE; sprite++, coverage >>= 1)
+	{
+		if (coverage & 0x1)
+			selected[count++] = static_cast<Byte>(sprite);
+	}
+
+	/* DMG: lower X first, OAM index breaks ties (stable insertion sort) */
+	if (_xPriority)
+	{
+		for (unsigned int i = 1; i < count; i++)
+		{
+			const Byte sprite = selected[i];
+			unsigned int j = i;
+			for (; j > 0 && _x[selected[j - 1]] > _x[sprite]; j--)
+				selected[j] = selected[j - 1];
+			selected[j] = sprite;
+		}
+	}
+
+	_count[ly] = static_cast<u8>(count);
+	_dirty[ly] = false;
+}
@@ -0,0 +1,191 @@
+#include "timer.h"
+
+#include "vm.h"
+#include "save_state.h"
+
+
+#define TIMA_REGISTER 0xFF05
+#define TMA_REGISTER 0xFF06
+#define TAC_REGISTER 0xFF07
+
+/* TIMA reads 0 for one M-cycle after overflowing, then TMA is loaded and the interrupt requested */
+#define RELOAD_DELAY 4
+
+/* DIV after the boot ROM */
+#define INITIAL_COUNTER 0xABCC
+
+/* TIMA counts the falling edges of one bit of the 16 bit divider counter */
+static const unsigned int TAC_PERIODS[4] { 1024, 16, 64, 256 };
+
+#define TAC_PERIOD(_T) (static_cast<Ticks>(TAC_PERIODS[(_T) & 0x3]))
+
+
+Timer::Timer() :
+	_divBase{ 0 },
+	_cycles{ 0 },
+	_reloadAt{ INVALID_TICKS },
+	_tima{ 0 },
+	_tma{ 0 },
+	_tac{ 0 }
+{
+	reset();
+}
+
+void Timer::reset()
+{
+	_divBase = 0 - static_cast<Ticks>(INITIAL_COUNTER);
+	_cycles = 0;
+	_reloadAt = INVALID_TICKS;
+	_tima = 0;
+	_tma = 0;
+	_tac = 0xF8;
+}
+
+Byte Timer::readRegister(VirtualMachine& vm, const Address addr)
+{
+	const Ticks now = vm.cpu.cycles();
+	switch (addr)
+	{
+		case DIV_REGISTER: return static_cast<Byte>(counter(now) >> 8);
+		case TIMA_REGISTER: update(vm, now); return _tima;
+		case TMA_REGISTER: return _tma;
+		case TAC_REGISTER: return 0xF8 | _tac;
+		default: return 0xFF;
+	}
+}
+
+void Timer::writeRegister(VirtualMachine& vm, const Address addr, const Byte value)
+{
+	const Ticks now = vm.cpu.cycles();
+	update(vm, now);
+
+	switch (addr)
+	{
+		case DIV_REGISTER:
+			/* resetting the counter drops the selected bit: a falling edge if it was set */
+			if (signal(now))
+				increment(now);
+			_divBase = now;
+			break;
+
+		case TIMA_REGISTER:
+			/* a write during the reload delay cancels the reload */
+			_reloadAt = INVALID_TICKS;
+			_tima = value;
+			break;
+
+		case TMA_REGISTER:
+			_tma = value;
+			break;
+
+		case TAC_REGISTER: {
+			const bool before = signal(now);
+			_tac = 0xF8 | (value & 0x7);
+			if (before && !signal(now))
+				increment(now);
+		} break;
+
+		default: return;
+	}
+
+	schedule(vm);
+}
+
+void Timer::overflowEvent(VirtualMachine& vm, const Ticks when)
+{
+	update(vm, vm.cpu.ticksToCycles(when));
+	schedule(vm);
+}
+
+void Timer::update(VirtualMachine& vm, const Ticks now)
+{
+	while (_cycles < now)
+	{
+		if (_reloadAt != INVALID_TICKS)
+		{
+			if (_reloadAt > now)
+				break;
+			_cycles = _reloadAt;
+			reload(vm);
+			continue;
+		}
+
+		if (!enabled())
+			break;
+
+		const Ticks period = TAC_PERIOD(_tac);
+		const Ticks edges = (now - _divBase) / period - (_cycles - _divBase) / period;
+		const Ticks toOverflow = 0x100 - _tima;
+		if (edges < toOverflow)
+		{
+			_tima += static_cast<Byte>(edges);
+			break;
+		}
+
+		/* the edges are multiples of the period on the divider counter */
+		const Ticks first = _divBase + ((_cycles - _divBase) / period + 1) * period;
+		_cycles = first + (toOverflow - 1) * period;
+		_tima = 0;
+		_reloadAt = _cycles + RELOAD_DELAY;
+	}
+
+	if (_cycles < now)
+		_cycles = now;
+}
+
+void Timer::increment(const Ticks when)
+{
+	if (_reloadAt != INVALID_TICKS)
+		return;
+
+	if (++_tima == 0)
+		_reloadAt = when + RELOAD_DELAY;
+}
+
+void Timer::reload(VirtualMachine& vm)
+{
+	_reloadAt = INVALID_TICKS;
+	_tima = _tma;
+	vm.ints.request(Interrupt::Timer);
+}
+
+void Timer::schedule(VirtualMachine& vm)
+{
+	if (_reloadAt != INVALID_TICKS)
+		vm.scheduler.schedule(SchedulerEvent::TimerOverflow, vm.cpu.cyclesToTicks(_reloadAt));
+	else if (enabled())
+	{
+		const Ticks period = TAC_PERIOD(_tac);
+		const Ticks first = _divBase + ((_cycles - _divBase) / period + 1) * period;
+		vm.scheduler.schedule(SchedulerEvent::TimerOverflow, vm.cpu.cyclesToTicks(first + (0xFF - _tima) * period + RELOAD_DELAY));
+	}
+	else vm.scheduler.cancel(SchedulerEvent::TimerOverflow);
+}
+
+bool Timer::signal(const Ticks now) const
+{
+	return enabled() && (counter(now) & (TAC_PERIOD(_tac) / 2)) != 0;
+}
+
+void Timer::saveState(StateWriter& state) const
+{
+	state.begin(STATE_SECTION('T', 'I', 'M', 'R'));
+	state.write(_divBase);
+	state.write(_cycles);
+	state.write(_reloadAt);
+	state.write(_tima);
+	state.write(_tma);
+	state.write(_tac);
+	state.end();
+}
+
+void Timer::loadState(StateReader& state)
+{
+	state.begin(STATE_SECTION('T', 'I', 'M', 'R'));
+	state.read(_divBase);
+	state.read(_cycles);
+	state.read(_reloadAt);
+	state.read(_tima);
+	state.read(_tma);
+	state.read(_tac);
+}
@@ -1,19 +1,165 @@
 #include "vm.h"
 
-VirtualMachine::VirtualMachine(const Bios::Type bios) :
-	mmu{ bios },
+VirtualMachine::VirtualMachine(const Bios::Type bios, const bool headless) :
+	mmu{ *this, bios },
 	cpu{},
 	regs{},
 	ints{},
-	stack{ *this }
-{}
+	ppu{ bios, headless },
+	apu{ headless },
+	timer{},
+	serial{ bios },
+	joypad{},
+	scheduler{},
+	stack{ *this },
+	_breakpoints{},
+	_breakpointCount{ 0 }
+{
+	startScheduler();
+}
 VirtualMachine::~VirtualMachine() {}
 
+std::unique_ptr<VirtualMachine> VirtualMachine::clone(const bool headless) const
+{
+	std::unique_ptr<VirtualMachine> copy{ new VirtualMachine{ mmu.bios().isGBC() ? Bios::Type::GameBoyColor : Bios::Type::GameBoy, headless } };
+
+	copy->mmu.copyState(mmu);
+	copy->cpu = cpu;
+	copy->regs = regs;
+	copy->ints = ints;
+	copy->ppu.copyState(ppu);
+	copy->apu.copyState(apu);
+	copy->timer = timer;
+	copy->serial.copyState(serial);
+	copy->joypad.copyState(joypad);
+	copy->scheduler = scheduler;
+
+	/* host driven events follow the frontend, not the source */
+	copy->joypad.schedule(*copy);
+	copy->serial.schedule(*copy);
+	return copy;
+}
+
 void VirtualMachine::reset()
 {
+	mmu.reset();
 	cpu.reset();
 	regs.reset();
 	ints.reset();
+	ppu.reset();
+	apu.reset();
+	timer.reset();
+	serial.reset();
+	joypad.reset();
+	startScheduler();
+}
+
+/* Events that are always pending while the machine runs */
+void VirtualMachine::startScheduler()
+{
+	scheduler.reset();
+	scheduler.schedule(SchedulerEvent::FrameSequencer, cpu.ticks() + APU_SEQUENCER_PERIOD);
+	ppu.schedule(*this);
+	serial.schedule(*this);
+	joypad.schedule(*this);
+}
+
+RunStatus VirtualMachine::runCycles(const Ticks cycles) { return run(cpu.ticks() + cycles, false); }
+RunStatus VirtualMachine::runFrame() { return run(cpu.ticks() + FRAME_TICKS, true); }
+
+RunStatus VirtualMachine::run(const Ticks limit, const bool untilFrame)
+{
+	const u64 frame = ppu.frameCount();
+	bool resumed = true;
+
+	while (cpu.ticks() < limit)
+	{
+		if (cpu.isStopped())
+			return RunStatus::Stopped;
+
+		if (_breakpointCount && !resumed && !cpu.isHalted() && (*_breakpoints)[regs.PC])
+			return RunStatus::Breakpoint;
+		resumed = false;
+
+		cpu.step(*this, limit);
+
+		if (untilFrame && ppu.frameCount() != frame)
+			return RunStatus::FrameComplete;
+	}
+
+	return untilFrame ? RunStatus::FrameComplete : RunStatus::CyclesDone;
+}
+
+u8 VirtualMachine::machine() const
+{
+	return static_cast<u8>(mmu.bios().isGBC() ? Bios::Type::GameBoyColor : Bios::Type::GameBoy);
+}
+
+void VirtualMachine::saveState(SaveState& state) const
+{
+	StateWriter writer{ state, machine() };
+	cpu.saveState(writer);
+	regs.saveState(writer);
+	ints.saveState(writer);
+	scheduler.saveState(writer);
+	timer.saveState(writer);
+	serial.saveState(writer);
+	joypad.saveState(writer);
+	mmu.saveState(writer);
+	ppu.saveState(writer);
+	apu.saveState(writer);
+}
+
+bool VirtualMachine::loadState(const SaveState& state) { return loadState(state.data(), state.size()); }
+
+bool VirtualMachine::loadState(const Byte* data, const size_t size)
+{
+	StateReader reader{ data, size };
+	CHECK(SUCCESS(reader.open(machine())));
+
+	cpu.loadState(reader);
+	regs.loadState(reader);
+	ints.loadState(reader);
+	scheduler.loadState(reader);
+	timer.loadState(reader);
+	serial.loadState(reader, cpu.ticks());
+	joypad.loadState(reader);
+	mmu.loadState(reader);
+	ppu.loadState(reader);
+	apu.loadState(reader);
+
+	if (!reader.ok())
+	{
+		/* a damaged state leaves a half loaded machine behind */
+		reset();
+		CHECK_MSG(false, "corrupt save state.\n");
+	}
+
+	/* host driven events follow the frontend, not the state */
+	joypad.schedule(*this);
+	serial.schedule(*this);
+	return OK;
+
+	ON_ERROR_RETURN;
+}
+
+void VirtualMachine::setBreakpoint(const Address addr, const bool enabled)
+{
+	if (hasBreakpoint(addr) == enabled)
+		return;
+
+	if (!_breakpoints)
+		_breakpoints.reset(new std::bitset<BREAKPOINT_SPACE>{});
+	(*_breakpoints)[addr] = enabled;
+	if (enabled)
+		_breakpointCount++;
+	else _breakpointCount--;
+}
+
+void VirtualMachine::clearBreakpoints()
+{
+	_breakpoints.reset();
+	_breakpointCount = 0;
 }
 
 